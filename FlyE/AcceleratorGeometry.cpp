@@ -1,7 +1,16 @@
 #include "AcceleratorGeometry.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "ElectrodeLoader.h"
+#include "ImportPipeline.h"
+#include "LaplaceSolver.h"
+#include "PhysicalConstants.h"
+#include "PotentialArray.h"
 #include "SubConfig.h"
-#include "ezETAProgressBar.hpp"
 
 AcceleratorGeometry::AcceleratorGeometry(
     std::shared_ptr<AcceleratorConfig> config)
@@ -10,48 +19,397 @@ AcceleratorGeometry::AcceleratorGeometry(
 }
 
 void AcceleratorGeometry::importElectrodes() {
-  std::cout << "Importing " << config_->nElectrodes() << " electrodes..." << std::endl;
+  if (config_->lazyLoading() && startLazyLoading()) return;
+
+  bool imported = loadBasis();
+
+  // The locator needs the full 32-bit fields, so find the electrodes before cropping or packing them
+  locator_ = std::make_shared<ElectrodeLocator>(electrodes_[0]);
+  for (auto electrode = electrodes_.begin() + 1; electrode < electrodes_.end(); ++electrode) {
+    *locator_ += ElectrodeLocator(*electrode);
+  }
+
+  if (imported && config_->useFieldCache()) {
+    fieldCache_->write(electrodes_, *locator_);
+  }
+
+  if (config_->rotationalSymmetry() || config_->periodic()) {
+    findSymmetries();
+  }
+
+  cropBasis();  // Even with no cutoff, this records each Electrode's support
+
+  if (config_->basisStorage() != "float32") {
+    if (sharedBasis_) {  // Every process would pack its own copy, when the point is to hold one per machine
+      std::cout << "The basis is shared, so it's kept as float32 rather than packed as " << config_->basisStorage()
+                << std::endl;
+    } else {
+      packBasis();
+    }
+  }
+
+  if (config_->interleavedBasis()) {  // After packing, so it has the same precision as the Electrodes
+    interleaved_ = std::make_shared<InterleavedBasis>(electrodes_, config_->x(), config_->y(), config_->z());
+    std::cout << "Interleaved the basis (" << interleaved_->size() / 1e6 << " MB, " << InterleavedBasis::SIMD_WIDTH
+              << "-wide SIMD)" << std::endl;
+  }
+}
 
-  ez::ezETAProgressBar importBar(config_->nElectrodes());
-  importBar.start();
+bool AcceleratorGeometry::startLazyLoading() {
+  fieldCache_ = std::make_shared<FieldCache>(config_);
 
-  for (int e = 0; e < config_->nElectrodes(); ++e, ++importBar) {
+  if (!config_->useFieldCache() || !fieldCache_->load() || fieldCache_->locations() == nullptr) {
+    std::cout << "Lazy loading needs an up-to-date field cache; importing every electrode this time" << std::endl;
+    return false;
+  }
+
+  if (config_->rotationalSymmetry() || config_->periodic()) {
+    std::cout << "Symmetries aren't used with lazy loading" << std::endl;
+  }
+
+  for (int e = 0; e < config_->nElectrodes(); ++e) {
+    electrodes_.emplace_back(std::make_shared<Electrode>(e + 1));  // Empty (and with an empty support) until loaded
+  }
+
+  locator_ = std::make_shared<ElectrodeLocator>(fieldCache_->locations(), config_->x(), config_->y(), config_->z());
+  loader_ = std::make_shared<ElectrodeLoader>(config_, fieldCache_);
+
+  std::cout << "Electrodes will be loaded from " << fieldCache_->path() << " as they're needed" << std::endl;
+  return true;
+}
+
+bool AcceleratorGeometry::loadBasis() {
+  for (int e = 0; e < config_->nElectrodes(); ++e) {
     electrodes_.emplace_back(std::make_shared<Electrode>(e + 1));
-    electrodes_[e]->import(config_);
   }
 
-  std::cout << std::endl;
+  fieldCache_ = std::make_shared<FieldCache>(config_);
+  bool publishing = false;
+
+  if (config_->sharedMemory()) {
+    sharedStore_ = std::make_shared<SharedGeometryStore>(config_, fieldCache_);
+
+    if (sharedStore_->attach(electrodes_)) {
+      std::cout << "Attached " << config_->nElectrodes() << " electrodes from shared geometry " << sharedStore_->name() << std::endl;
+      sharedBasis_ = true;
+      return false;
+    }
+
+    publishing = sharedStore_->create(electrodes_);  // Import straight into the new segment
+    if (!publishing && sharedStore_->attach(electrodes_)) {  // Lost the race to create it
+      std::cout << "Attached " << config_->nElectrodes() << " electrodes from shared geometry " << sharedStore_->name() << std::endl;
+      sharedBasis_ = true;
+      return false;
+    }
+  }
+
+  bool imported = false;
+
+  if (config_->useFieldCache() && fieldCache_->load()) {
+    if (publishing) {
+      for (int e = 0; e < config_->nElectrodes(); ++e) {
+        std::memcpy(electrodes_[e]->data(), fieldCache_->fields(e),
+                    electrodes_[e]->numElements() * sizeof(blitz::TinyVector<float, 3>));
+      }
+      std::cout << "Copied " << config_->nElectrodes() << " electrodes from " << fieldCache_->path() << std::endl;
+    } else {
+      fieldCache_->attach(electrodes_);
+      std::cout << "Mapped " << config_->nElectrodes() << " electrodes from " << fieldCache_->path() << std::endl;
+    }
+
+    if (config_->solveLaplace()) {
+      std::cout << "The cached fields were solved to a tolerance of " << config_->laplaceTolerance() << std::endl;
+    }
+  } else {
+    if (!publishing) {
+      for (auto &electrode : electrodes_) {
+        electrode->resize(config_->x(), config_->y(), config_->z());
+      }
+    }
+
+    bool success;
+    if (config_->solveLaplace()) {
+      success = solveBasis();
+    } else {
+      success = (config_->paDirectory().empty()) ? importDatFiles() : importPotentialArrays();
+    }
+
+    if (!success) {
+      std::cout << "Some source files couldn't be read; not caching or sharing this geometry" << std::endl;
+      if (publishing) sharedStore_->abandon();
+      return false;
+    }
+
+    imported = true;
+  }
+
+  if (publishing) {
+    sharedStore_->publish();
+    sharedBasis_ = true;
+  }
+
+  return imported;
+}
+
+void AcceleratorGeometry::findSymmetries() {
+  bool rotations = config_->rotationalSymmetry();
+  bool periodic = config_->periodic();
+  int nSections = config_->nElectrodes() / Physics::N_IN_SECTION;
+  int sectionWidth = Physics::N_IN_SECTION * config_->z() / config_->nElectrodes();
+
+  if (rotations && config_->x() != config_->y()) {
+    std::cout << "The geometry isn't square in x-y, so rotational symmetry can't be used" << std::endl;
+    rotations = false;
+  }
+
+  if (periodic && sectionWidth * nSections != config_->z()) {
+    std::cout << "The sections aren't a whole number of grid points long, so the geometry can't be periodic" << std::endl;
+    periodic = false;
+  }
+
+  if (!rotations && !periodic) return;
+
+  std::vector<int> roots(config_->nElectrodes());  // The Electrode whose field each Electrode uses (itself if it keeps its own)
+  int nImages = 0;
+  float maxError = 0.0;
+
+  for (int section = 0; section < nSections; ++section) {
+    std::vector<int> candidates;  // Electrodes that this section's Electrodes might be images of
+
+    if (periodic && section > 0) {  // Whatever the last section was made from, moved along by a section
+      for (int e = (section - 1) * Physics::N_IN_SECTION; e < section * Physics::N_IN_SECTION; ++e) {
+        if (std::find(candidates.begin(), candidates.end(), roots[e]) == candidates.end()) {
+          candidates.push_back(roots[e]);
+        }
+      }
+    }
+
+    for (int e = section * Physics::N_IN_SECTION; e < (section + 1) * Physics::N_IN_SECTION; ++e) {
+      roots[e] = e;
+
+      for (auto candidate = candidates.begin(); candidate < candidates.end() && roots[e] == e; ++candidate) {
+        int zShift = (section - *candidate / Physics::N_IN_SECTION) * sectionWidth;
+
+        for (int turns = 0; turns < 4 && roots[e] == e; ++turns) {
+          if ((turns == 0 && zShift == 0) || (turns != 0 && !rotations)) continue;
+
+          float error = electrodes_[e]->imageError(*electrodes_[*candidate], turns, zShift);
+
+          if (error <= config_->symmetryTolerance()) {
+            electrodes_[e]->makeImage(electrodes_[*candidate], turns, zShift);
+            maxError = std::max(maxError, error);
+            roots[e] = *candidate;
+            ++nImages;
+          }
+        }
+      }
+
+      if (roots[e] == e && rotations) {  // The rest of the section might be rotations of it
+        candidates.push_back(e);
+      }
+    }
+  }
+
+  std::cout << "Symmetry: " << nImages << " of " << config_->nElectrodes()
+            << " electrodes are stored as images of others (max error " << 100 * maxError << "% of the peak field)" << std::endl;
+}
+
+void AcceleratorGeometry::cropBasis() {
+  size_t bytesBefore = 0;
+  size_t bytesAfter = 0;
+
+  for (auto &electrode : electrodes_) {  // Images follow their sources, which always come first
+    bytesBefore += electrode->fieldBytes();
+    electrode->crop(config_->supportCutoff(), !sharedBasis_);  // A shared field stays where it is
+    bytesAfter += electrode->fieldBytes();
+  }
+
+  if (config_->supportCutoff() <= 0.0) return;
+
+  if (sharedBasis_) {
+    std::cout << "Found the electrodes' supports (|E| > " << config_->supportCutoff()
+              << " of their peaks); the shared fields aren't copied" << std::endl;
+    return;
+  }
+
+  std::cout << "Cropped the electrodes to |E| > " << config_->supportCutoff() << " of their peaks: " << bytesBefore / 1e6
+            << " MB -> " << bytesAfter / 1e6 << " MB" << std::endl;
+}
+
+void AcceleratorGeometry::packBasis() {
+  Electrode::Storage storage = Electrode::storageFromName(config_->basisStorage());
+  size_t bytesBefore = 0;
+  size_t bytesAfter = 0;
+  float maxError = 0.0;
+  float maxPeak = 0.0;
+
+  for (auto &electrode : electrodes_) {
+    bytesBefore += electrode->fieldBytes();
+
+    float peak;
+    maxError = std::max(maxError, electrode->pack(storage, peak));
+    maxPeak = std::max(maxPeak, peak);
+
+    bytesAfter += electrode->fieldBytes();
+  }
+
+  std::cout << "Packed the electrodes as " << config_->basisStorage() << ": " << bytesBefore / 1e6 << " MB -> "
+            << bytesAfter / 1e6 << " MB" << std::endl;
+  std::cout << "Max field error: " << maxError << " V/m (" << ((maxPeak > 0) ? 100 * maxError / maxPeak : 0)
+            << "% of the peak 1V field)" << std::endl;
+}
+
+bool AcceleratorGeometry::importDatFiles() {
+  ImportPipeline pipeline(config_, electrodes_);
+
+  return pipeline.run();
+}
+
+bool AcceleratorGeometry::importPotentialArrays() {
+  std::cout << "Deriving " << config_->nElectrodes() << " electrodes from .pa files..." << std::endl;
+
+  size_t bytesRead = 0;
+  bool success = true;
+  auto startTime = std::chrono::steady_clock::now();
+
+  for (int e = 0; e < config_->nElectrodes(); ++e) {  // The derivation is parallel within each file
+    PotentialArray potentials(config_->paPath(e + 1));
+    if (!potentials.isOpen()) {
+      success = false;
+      continue;
+    }
+
+    if (potentials.nx() != config_->x() + 2 || potentials.ny() != config_->y() + 2
+        || potentials.nz() != config_->z() + 2) {
+      std::cout << "Wrong dimensions in .pa file: " << config_->paPath(e + 1) << std::endl;
+      success = false;
+      continue;
+    }
+
+    potentials.deriveField(reinterpret_cast<float*>(electrodes_[e]->data()), config_->x(), config_->y(), config_->z(),
+                           config_->paPixelSize());
+    bytesRead += potentials.size();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+  std::cout << "Derived the fields from " << bytesRead / 1e6 << " MB in " << elapsed.count() << " s ("
+            << bytesRead / 1e6 / elapsed.count() << " MB/s)" << std::endl;
+
+  return success;
+}
+
+bool AcceleratorGeometry::solveBasis() {
+  PotentialArray geometry(config_->paGeometryPath());
+  if (!geometry.isOpen()) return false;
+
+  const int nx = config_->x() + 2, ny = config_->y() + 2, nz = config_->z() + 2;
+  if (geometry.nx() != nx || geometry.ny() != ny || geometry.nz() != nz) {
+    std::cout << "Wrong dimensions in .pa# file: " << config_->paGeometryPath() << std::endl;
+    return false;
+  }
+
+  std::cout << "Solving for " << config_->nElectrodes() << " electrodes from " << config_->paGeometryPath() << "..."
+            << std::endl;
+
+  LaplaceSolver solver(LaplaceSolver::labelsFromGeometry(geometry), nx, ny, nz, config_->laplaceTolerance());
+  auto startTime = std::chrono::steady_clock::now();
+  int totalCycles = 0;
+
+  for (int e = 0; e < config_->nElectrodes(); ++e) {  // The solver is parallel within each electrode
+    int nCycles;
+    // Numbered backwards, like the .dat and .pa files
+    std::vector<double> potentials = solver.solve(config_->nElectrodes() - e, nCycles);
+    totalCycles += nCycles;
+
+    PotentialArray::deriveField(potentials.data(), nx, ny, nz, LaplaceSolver::ELECTRODE_VOLTAGE,
+                                reinterpret_cast<float*>(electrodes_[e]->data()), config_->x(), config_->y(),
+                                config_->z(), config_->paPixelSize());
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+  std::cout << "Solved in " << elapsed.count() << " s (" << static_cast<double>(totalCycles) / config_->nElectrodes()
+            << " V-cycles per electrode)" << std::endl;
+
+  return true;
 }
 
 void AcceleratorGeometry::applyElectrodeVoltages(std::vector<float> voltages) {
   for (unsigned int e = 0; e < voltages.size(); ++e) {
+    // Swap in lazily loaded Electrodes once they're ready, or straight away (waiting if need be) if they're needed
+    if (loader_ && (voltages[e] != 0.0 || loader_->isLoaded(e))) {
+      electrodes_[e] = loader_->get(e);
+    }
+
     electrodes_[e]->applyVoltage(voltages[e]);
   }
 }
 
+void AcceleratorGeometry::prefetchElectrodes(const std::vector<bool> &upcoming) {
+  if (!loader_) return;
+
+  for (unsigned int e = 0; e < upcoming.size(); ++e) {
+    if (upcoming[e]) loader_->prefetch(e);
+  }
+}
+
 SmartField AcceleratorGeometry::makeSmartField() {
-  return SmartField(electrodes_);
+  return SmartField(electrodes_, config_->x(), config_->y(), config_->z(), interleaved_);
 }
 
-VectorField AcceleratorGeometry::makeVectorField() {
-  VectorField thisField(*electrodes_[0]);
+void AcceleratorGeometry::updateSmartField(SmartField &field) {
+  field.updateVoltages(electrodes_);
+}
 
-#pragma omp parallel for
-  for (auto electrode = electrodes_.begin() + 1; electrode < electrodes_.end(); ++electrode) {
-    thisField += *(*electrode) * (*electrode)->getVoltage();
+void AcceleratorGeometry::useVoltageModes(SmartField &field, const std::vector<std::vector<float> > &patterns) {
+  for (unsigned int e = 0; loader_ && e < electrodes_.size(); ++e) {
+    bool inPatterns = false;
+    for (auto &pattern : patterns) {
+      inPatterns = inPatterns || pattern[e] != 0.0;
+    }
+
+    if (inPatterns) {
+      float voltage = electrodes_[e]->getVoltage();
+      electrodes_[e] = loader_->get(e);
+      electrodes_[e]->applyVoltage(voltage);
+    }
   }
 
-  return thisField;
+  field.setModes(electrodes_, patterns);
+  std::cout << "Superposed " << patterns.size() << " voltage patterns" << std::endl;
 }
 
-ElectrodeLocator AcceleratorGeometry::electrodeLocations() {
-  ElectrodeLocator locator(electrodes_[0]);
+void AcceleratorGeometry::usePhaseTable(SmartField &field, const std::vector<std::vector<float> > &patterns,
+                                        int nPhases) {
+  auto table = std::make_shared<PhaseTable>(config_, patterns, nPhases);
 
-  for (auto electrode = electrodes_.begin() + 1; electrode < electrodes_.end(); ++electrode) {
-    locator += ElectrodeLocator(*electrode);
+  if (config_->useFieldCache() && table->load()) {  // No need for the patterns' fields, or their Electrodes
+    field.usePhaseTable(table);
+    std::cout << "Mapped " << nPhases << " trap phases from " << table->path() << std::endl;
+    return;
+  }
+
+  useVoltageModes(field, patterns);
+  field.usePhaseTable(table);
+  std::cout << "Tabulated " << nPhases << " trap phases (" << table->size() / 1e6 << " MB)" << std::endl;
+}
+
+VectorField AcceleratorGeometry::makeVectorField() {
+  VectorField thisField(config_->x(), config_->y(), config_->z());  // Not a copy of an Electrode: that would share (possibly read-only) memory with it
+
+  std::vector<float> voltages;
+  for (auto &electrode : electrodes_) {
+    voltages.push_back(electrode->getVoltage());
   }
 
-  return locator;
+  SuperpositionEngine(config_->x(), config_->y(), config_->z()).superpose(electrodes_, voltages, thisField);
+
+  return thisField;
+}
+
+ElectrodeLocator AcceleratorGeometry::electrodeLocations() {
+  return *locator_;
 }
 
 std::shared_ptr<AcceleratorConfig> AcceleratorGeometry::getAcceleratorConfig() {
@@ -11,8 +11,11 @@
 #include "Electrode.h"
 #include "SmartField.h"
 #include "ElectrodeLocator.h"
+#include "FieldCache.h"
+#include "SharedGeometryStore.h"
 
 class AcceleratorConfig;
+class ElectrodeLoader;
 
 /** @brief A class for handling the complete geometry of the accelerator
  *
@@ -24,6 +27,66 @@ class AcceleratorGeometry {
  protected:
   std::vector< std::shared_ptr<Electrode> > electrodes_; //!< For storing (pointers) to all the Electrodes in the accelerator
   std::shared_ptr<AcceleratorConfig> config_; //!< The configuration data for the geometry
+  std::shared_ptr<FieldCache> fieldCache_; //!< The binary field cache, which owns the Electrodes' memory if they were mapped from it
+  std::shared_ptr<SharedGeometryStore> sharedStore_; //!< The shared memory segment, which owns the Electrodes' memory if they are shared
+  bool sharedBasis_ = false; //!< Whether the Electrodes' fields are in a shared memory segment (attached, or published by this process)
+  std::shared_ptr<ElectrodeLocator> locator_; //!< Where the electrodes are, found before the fields are packed
+  std::shared_ptr<ElectrodeLoader> loader_; //!< Loads the Electrodes in the background, if they're loaded lazily
+  std::shared_ptr<const InterleavedBasis> interleaved_; //!< The basis with the electrodes varying fastest, if it's configured
+
+  /** @brief Fills the Electrodes with their fields, from shared memory, the field cache or the .dat (or .pa) files
+   *
+   * @see importElectrodes()
+   *
+   * @return true if the fields were imported from the source files (so should be cached)
+   */
+  bool loadBasis();
+
+  /** @brief Sets up empty Electrodes to be loaded from the field cache as they're needed
+   *
+   * @return true if lazy loading has started, false if there's no usable field cache (with electrode locations)
+   */
+  bool startLazyLoading();
+
+  /** @brief Stores Electrodes as images of others wherever the fields agree to within the tolerance
+   *
+   * With rotational symmetry, the Electrodes in a section can be rotations of each other. In a periodic geometry, each
+   * section can be the last section's sources moved along by a section (and turned, with rotational symmetry too).
+   */
+  void findSymmetries();
+
+  /** @brief Crops every Electrode to the box where its field is above the configured cutoff, and reports the memory saved
+   *
+   * With no cutoff, the Electrodes keep the whole grid; this still has to be called to record that as their support.
+   */
+  void cropBasis();
+
+  /** @brief Packs every Electrode into the configured basis storage format and reports the error that causes */
+  void packBasis();
+
+  /** @brief Imports every Electrode from the .dat files, with an ImportPipeline
+   *
+   * The Electrodes must already be the right size.
+   *
+   * @return true if every file was read
+   */
+  bool importDatFiles();
+
+  /** @brief Derives every Electrode's field from its SIMION .pa file
+   *
+   * The Electrodes must already be the right size.
+   *
+   * @return true if every file was read and has the configured dimensions
+   */
+  bool importPotentialArrays();
+
+  /** @brief Solves for every Electrode's field from the SIMION geometry (.pa#) file, with a LaplaceSolver
+   *
+   * The Electrodes must already be the right size.
+   *
+   * @return true if the geometry file was read and has the configured dimensions
+   */
+  bool solveBasis();
 
  public:
   /** @brief Constructs from a shared_ptr to an AcceleratorConfig instance
@@ -32,22 +95,77 @@ class AcceleratorGeometry {
    */
   AcceleratorGeometry(std::shared_ptr<AcceleratorConfig> config);
 
-  /** @brief Tells all electrodes to import their E-Field files */
+  /** @brief Tells all electrodes to import their E-Field files
+   *
+   * If shared memory is enabled and another process has already published the geometry, the Electrodes are attached to it.
+   * Otherwise, if the binary field cache is enabled and up to date, the Electrodes are mapped from it. Failing both, they are
+   * imported from the .dat files (or derived from the .pa files, if a .pa directory is configured, or solved for from the geometry file, if solve_laplace is set) and the cache is written for next time. If shared memory is enabled, the first process to get
+   * this far imports into a new segment and publishes it for the others.
+   *
+   * If lazy loading is enabled and the field cache is up to date, the Electrodes are left empty instead, and are loaded
+   * in the background as they're needed (see prefetchElectrodes()).
+   *
+   * The Electrodes are then located, replaced by images (rotations and/or moved copies) of each other where the geometry allows it, cropped to where their fields are significant if a support cutoff is configured, and
+   * packed if a 16-bit basis storage format is configured. Finally, the interleaved basis is made, if it's configured.
+   *
+   * @see FieldCache
+   * @see SharedGeometryStore
+   */
   void importElectrodes();
 
   /** @brief Applies electrode voltages in order from the vector
+   *
+   * With lazy loading, any Electrode that's given a voltage is loaded first (if it hasn't been prefetched, this waits for it).
    *
    * @param voltages A vector of voltages to apply, respectively, to the electrodes
    */
   void applyElectrodeVoltages(std::vector<float> voltages);
 
+  /** @brief Starts loading Electrodes that will soon be given voltages, if they're being loaded lazily
+   *
+   * @param upcoming Whether each Electrode might soon be given a voltage
+   *
+   * @see VoltageScheme::upcomingElectrodes()
+   */
+  void prefetchElectrodes(const std::vector<bool> &upcoming);
+
   /** @brief Returns a SmartField for the current state of the geometry
    *
    * @return Effectively the current field (given voltages) in the accelerator
    */
   SmartField makeSmartField();
 
-  /** @brief Sums all the Electrodes and returns the superposed field
+  /** @brief Brings a SmartField up to date with the current voltages, only changing what it needs to
+   *
+   * @param field A SmartField made by makeSmartField()
+   */
+  void updateSmartField(SmartField &field);
+
+  /** @brief Sets a SmartField up to blend the fields of a few fixed voltage patterns, instead of summing every Electrode
+   *
+   * With lazy loading, every Electrode in the patterns is loaded first (waiting for them if need be).
+   *
+   * @see VoltageScheme::modePatterns()
+   *
+   * @param field A SmartField made by makeSmartField()
+   * @param patterns A voltage for each Electrode, for each pattern
+   */
+  void useVoltageModes(SmartField &field, const std::vector< std::vector<float> > &patterns);
+
+  /** @brief Sets a SmartField up to look the field up in a PhaseTable, instead of blending the patterns' fields
+   *
+   * The table is mapped from its file if it's up to date (and the field cache is in use), without superposing the
+   * patterns or loading their Electrodes. Otherwise the patterns are superposed with useVoltageModes(), and the table is
+   * built from their fields, straight into its file (which is kept for next time if the field cache is in use); the field
+   * stops keeping the patterns' fields once it's built.
+   *
+   * @param field A SmartField made by makeSmartField()
+   * @param patterns The cosine and sine voltage patterns
+   * @param nPhases The number of phases to tabulate
+   */
+  void usePhaseTable(SmartField &field, const std::vector< std::vector<float> > &patterns, int nPhases);
+
+  /** @brief Sums all the Electrodes (with a SuperpositionEngine, so it's the same for any number of threads)
    *
    * @return The total field in the accelerator
    */
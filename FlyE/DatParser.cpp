@@ -0,0 +1,141 @@
+#include "DatParser.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "PhysicalConstants.h"
+
+namespace {
+
+// Exact powers of ten for the common exponents; anything else falls back to pow()
+constexpr double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+constexpr int MAX_EXACT_POWER = 22;
+constexpr int MAX_MANTISSA_DIGITS = 19; // Fits in a uint64_t
+
+inline bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+}
+
+const char* DatParser::scanFloat(const char *p, const char *end, double &value) {
+  const char *start = p;
+  bool negative = false;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int nDigits = 0;
+  int exponent = 0;
+  bool sawDigit = false;
+
+  for (; p < end && isDigit(*p); ++p) {  // Integer part
+    sawDigit = true;
+    if (nDigits < MAX_MANTISSA_DIGITS) {
+      mantissa = 10 * mantissa + (*p - '0');
+      if (mantissa != 0) ++nDigits;
+    } else {
+      ++exponent;  // Too many digits; just keep track of the magnitude
+    }
+  }
+
+  if (p < end && *p == '.') {  // Fractional part
+    for (++p; p < end && isDigit(*p); ++p) {
+      sawDigit = true;
+      if (nDigits < MAX_MANTISSA_DIGITS) {
+        mantissa = 10 * mantissa + (*p - '0');
+        if (mantissa != 0) ++nDigits;
+        --exponent;
+      }
+    }
+  }
+
+  if (!sawDigit) {
+    value = 0.0;
+    return start;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {  // Exponent
+    const char *exponentStart = p++;
+    bool negativeExponent = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = (*p == '-');
+      ++p;
+    }
+
+    if (p < end && isDigit(*p)) {
+      int explicitExponent = 0;
+      for (; p < end && isDigit(*p); ++p) {
+        if (explicitExponent < 10000) explicitExponent = 10 * explicitExponent + (*p - '0');
+      }
+      exponent += (negativeExponent) ? -explicitExponent : explicitExponent;
+    } else {
+      p = exponentStart;  // Not an exponent after all
+    }
+  }
+
+  double result = static_cast<double>(mantissa);
+  if (exponent < 0 && exponent >= -MAX_EXACT_POWER) {
+    result /= POWERS_OF_TEN[-exponent];
+  } else if (exponent > 0 && exponent <= MAX_EXACT_POWER) {
+    result *= POWERS_OF_TEN[exponent];
+  } else if (exponent != 0) {
+    result *= std::pow(10.0, exponent);
+  }
+
+  value = (negative) ? -result : result;
+  return p;
+}
+
+size_t DatParser::parseFile(const std::string &path, float *fields, int x,
+                            int d, int sizeY, int sizeZ) {
+  MappedFile datFile(path);
+
+  if (!datFile.isOpen()) {
+    std::cout << "Error reading .dat file: " << path << std::endl;
+    return 0;
+  }
+
+  const char *p = datFile.data();
+  const char *end = p + datFile.size();
+
+  for (int line = 0; line < HEADER_LINES && p < end; ++p) {  // Skip header text
+    if (*p == '\n') ++line;
+  }
+
+  float *layer = fields + static_cast<size_t>(x) * sizeY * sizeZ * Physics::N_DIMENSIONS + d;
+
+  for (int z = 0; p < end && z < sizeZ; ++z, ++p) {  // Lines ('\n' delimiter)
+    int y = 0;
+
+    while (p < end && *p != '\n') {  // Tabs (ie cells)
+      if (*p == '\t' || *p == ' ' || *p == '\r') {
+        ++p;
+        continue;
+      }
+
+      double value;
+      const char *next = scanFloat(p, end, value);
+
+      if (next == p) {  // Not a number, so it isn't a cell either
+        ++p;
+        continue;
+      }
+      p = next;
+
+      if (y < sizeY) {
+        layer[(static_cast<size_t>(y) * sizeZ + z) * Physics::N_DIMENSIONS] = Physics::SIMION_MULTIPLIER * value;
+      }
+      ++y;
+    }
+  }
+
+  return datFile.size();
+}
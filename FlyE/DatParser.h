@@ -0,0 +1,46 @@
+/**@file DatParser.h
+ * @brief This file contains the DatParser class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/** @brief A fast parser for EXSIMECK .dat files
+ *
+ * Each .dat file holds one component of one electrode's field on one x-layer: 8 lines of header text, then one line per z
+ * with tab-separated cells for each y. The file is memory-mapped and scanned in place with a hand-rolled float scanner,
+ * and the values are written straight into the Electrode's Blitz++ storage, so nothing is allocated per line or per cell.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class DatParser {
+ public:
+  static constexpr int HEADER_LINES = 8; //!< Number of lines of header text at the top of each .dat file
+
+  /** @brief Parses one .dat file into a field
+   *
+   * @param path Path to the .dat file
+   * @param fields The first float of the field, laid out like Blitz++ stores an Array<TinyVector<float, 3>, 3>
+   * @param x The x-layer that the file holds
+   * @param d The dimension that the file holds (0 = x, 1 = y, 2 = z)
+   * @param sizeY The size of the field along y
+   * @param sizeZ The size of the field along z
+   * @return The number of bytes parsed, or 0 if the file couldn't be read
+   */
+  static size_t parseFile(const std::string &path, float *fields, int x, int d, int sizeY, int sizeZ);
+
+  /** @brief Scans a decimal floating point number
+   *
+   * Understands an optional sign, digits with an optional decimal point and an optional exponent. If there's no number at p,
+   * nothing is consumed and value is 0.
+   *
+   * @param p Where to start scanning
+   * @param end The end of the buffer
+   * @param value Set to the number that was scanned
+   * @return The first character after the number, or p if there wasn't one
+   */
+  static const char* scanFloat(const char *p, const char *end, double &value);
+};
@@ -1,13 +1,30 @@
 #include "Electrode.h"
 
+#include <algorithm>
 #include <blitz/array.h>
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <string>
+#include <cmath>
 
 #include "PhysicalConstants.h"
 
+namespace {
+
+// Turns a box of points on a square x-y grid (with largest index last) anticlockwise about the z-axis, then moves it
+// along z and clips it to a grid of the given depth
+GridBox moveBox(GridBox box, int quarterTurns, int last, int zShift, int depth) {
+  if (box.empty()) return box;
+
+  for (int turn = 0; turn < quarterTurns; ++turn) {  // (x, y) -> (last - y, x)
+    box = GridBox(last - box.y1, box.x0, box.z0, last - box.y0, box.x1, box.z1);
+  }
+
+  box.z0 = std::max(box.z0 + zShift, 0);
+  box.z1 = std::min(box.z1 + zShift, depth - 1);
+
+  return box;
+}
+
+}
+
 Electrode::Electrode() : electrodeNumber_(0), currentVoltage_(0) {}
 
 Electrode::Electrode(int electrodeNumber)
@@ -16,63 +33,229 @@ Electrode::Electrode(int electrodeNumber)
 
 Electrode::Electrode(const Electrode &elec)
     : VectorField(elec),
-      electrodeNumber_(elec.currentVoltage_),
-      currentVoltage_(elec.currentVoltage_){
+      electrodeNumber_(elec.electrodeNumber_),
+      currentVoltage_(elec.currentVoltage_),
+      storage_(elec.storage_),
+      packed_(elec.packed_),
+      scale_(elec.scale_),
+      sizeX_(elec.sizeX_),
+      sizeY_(elec.sizeY_),
+      sizeZ_(elec.sizeZ_),
+      support_(elec.support_),
+      source_(elec.source_),
+      quarterTurns_(elec.quarterTurns_),
+      zShift_(elec.zShift_),
+      rotationSize_(elec.rotationSize_),
+      imageDepth_(elec.imageDepth_) {
 }
 
 void Electrode::applyVoltage(float voltage) {
   currentVoltage_ = voltage;
 }
 
-void Electrode::import(std::shared_ptr<AcceleratorConfig> config) {
-  this->resize(config->x(), config->y(), config->z());
+void Electrode::attach(blitz::TinyVector<float, 3> *fields, int x, int y, int z) {
+  this->reference(blitz::Array<blitz::TinyVector<float, 3>, 3>(fields, blitz::shape(x, y, z), blitz::neverDeleteData));
+  support_ = GridBox(0, 0, 0, x - 1, y - 1, z - 1);
+}
+
+float Electrode::getVoltage() {
+  return currentVoltage_;
+}
 
-#pragma omp parallel for
-  for (int x = 0; x < config->x(); ++x) {  // Layers (excluding nx-th and first)
+float Electrode::imageError(const Electrode &source, int quarterTurns, int zShift) const {
+  Electrode moved;  // Lightweight: just borrows the source's field
+  moved.source_ = std::make_shared<Electrode>(source);
+  moved.quarterTurns_ = quarterTurns;
+  moved.zShift_ = zShift;
+  moved.rotationSize_ = this->extent(0);
+
+  int depth = this->extent(2);
+
+  float peak = 0.0;
+  float maxError = 0.0;
+
+#pragma omp parallel for reduction(max:peak, maxError)
+  for (int x = 0; x < this->extent(0); ++x) {
+    for (int y = 0; y < this->extent(1); ++y) {
+      for (int z = 0; z < this->extent(2); ++z) {
+        blitz::TinyVector<float, 3> field = (*this)(x, y, z);
+        peak = std::max(peak, VectorField::vectorMagnitude(field));
+
+        if (z - zShift >= 0 && z - zShift < depth) {
+          field -= moved.imageFieldAt(x, y, z);
+        }
+        maxError = std::max(maxError, VectorField::vectorMagnitude(field));
+      }
+    }
+  }
+
+  return (peak > 0.0) ? maxError / peak : maxError;
+}
+
+void Electrode::makeImage(std::shared_ptr<Electrode> source, int quarterTurns, int zShift) {
+  rotationSize_ = this->extent(0);
+  imageDepth_ = this->extent(2);
+  source_ = source;
+  quarterTurns_ = quarterTurns;
+  zShift_ = zShift;
+  support_ = moveBox(source_->support(), quarterTurns_, rotationSize_ - 1, zShift_, imageDepth_);
+
+  this->free();
+}
+
+std::shared_ptr<Electrode> Electrode::source() const {
+  return source_;
+}
 
-    std::string piece;
-    std::string line;
-    std::stringstream basePath;
+bool Electrode::isImage() const {
+  return source_ != nullptr;
+}
 
-    // width+2 to correct zero-indexing, and (nElectrodes - electrodeNumber_ + 1) to correct weird backwards numbering
-    basePath << config->datDirectory() << config->PAname() << "_E"
-             << config->nElectrodes() - electrodeNumber_ + 1 << "_L" << x + 2
-             << "_";
+void Electrode::crop(float cutoff, bool shrink) {
+  if (source_) {  // Follow the source
+    support_ = moveBox(source_->support(), quarterTurns_, rotationSize_ - 1, zShift_, imageDepth_);
+    return;
+  }
 
-    for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
-      std::stringstream path;
-      path << basePath.str() << Physics::axes[d] << ".dat";
-      blitz::Array<float, 3> thisDimension = this->extractComponent(float(), d,
-                                                                    3);  // Get this dimension
+  support_ = GridBox(this->lbound(0), this->lbound(1), this->lbound(2),
+                     this->ubound(0), this->ubound(1), this->ubound(2));
+  if (cutoff <= 0.0 || storage_ != Storage::FLOAT32) return;
 
-      std::ifstream datFile(path.str().c_str());
+  float peak = 0.0;
 
-      if (datFile.fail()) {
-        std::cout << "Error reading .dat file: " << path.str() << std::endl;
-        continue;
+#pragma omp parallel for reduction(max:peak)
+  for (int x = support_.x0; x <= support_.x1; ++x) {
+    for (int y = support_.y0; y <= support_.y1; ++y) {
+      for (int z = support_.z0; z <= support_.z1; ++z) {
+        peak = std::max(peak, VectorField::vectorMagnitude((*this)(x, y, z)));
       }
+    }
+  }
+
+  float threshold = cutoff * peak;
+  GridBox support;
 
-      int y = 0;
-      int z = -8;  // Skip header text
-
-      while (getline(datFile, line)) {  // Lines ('\n' delimiter)
-        if (z >= 0) {  // Ignore header text
-          y = 0;
-          std::stringstream linestream(line);
-          while (getline(linestream, piece, '\t')) {  // Tabs (ie cells)
-            thisDimension(x, y, z) = Physics::SIMION_MULTIPLIER * stod(piece);  // Ugly access to overloaded parentheses
-            ++y;
-          }
+#pragma omp parallel
+  {
+    GridBox threadSupport;
+
+#pragma omp for nowait
+    for (int x = support_.x0; x <= support_.x1; ++x) {
+      for (int y = support_.y0; y <= support_.y1; ++y) {
+        for (int z = support_.z0; z <= support_.z1; ++z) {
+          if (VectorField::vectorMagnitude((*this)(x, y, z)) > threshold) threadSupport.expand(x, y, z);
         }
-        ++z;
       }
-      datFile.close();
+    }
+
+#pragma omp critical
+    support.expand(threadSupport);
+  }
+
+  support_ = support;
 
-      this->extractComponent(float(), d, 3) = thisDimension;  // Put this dimension back
+  if (support_.empty()) {  // No field at all
+    this->free();
+    return;
+  }
+
+  if (!shrink) return;
+
+  // Same indices as the full grid, but only the box is allocated
+  blitz::Array<blitz::TinyVector<float, 3>, 3> boxed(blitz::Range(support_.x0, support_.x1),
+                                                      blitz::Range(support_.y0, support_.y1),
+                                                      blitz::Range(support_.z0, support_.z1));
+
+#pragma omp parallel for
+  for (int x = support_.x0; x <= support_.x1; ++x) {
+    for (int y = support_.y0; y <= support_.y1; ++y) {
+      for (int z = support_.z0; z <= support_.z1; ++z) {
+        boxed(x, y, z) = (*this)(x, y, z);
+      }
     }
   }
+
+  this->reference(boxed);
 }
 
-float Electrode::getVoltage() {
-  return currentVoltage_;
+const GridBox& Electrode::support() const {
+  return support_;
+}
+
+Electrode::Storage Electrode::storageFromName(const std::string &name) {
+  if (name == "float16") return Storage::FLOAT16;
+  if (name == "int16") return Storage::INT16;
+  return Storage::FLOAT32;
+}
+
+Electrode::Storage Electrode::storage() const {
+  return storage_;
+}
+
+size_t Electrode::fieldBytes() const {
+  return (storage_ == Storage::FLOAT32) ?
+      this->numElements() * sizeof(blitz::TinyVector<float, 3>) : packed_.size() * sizeof(uint16_t);
+}
+
+float Electrode::pack(Storage storage, float &peak) {
+  peak = 0.0;
+  if (source_ || storage == storage_ || storage_ != Storage::FLOAT32) return 0.0;
+
+  sizeX_ = this->extent(0);
+  sizeY_ = this->extent(1);
+  sizeZ_ = this->extent(2);
+
+  long nValues = Physics::N_DIMENSIONS * static_cast<long>(this->numElements());
+  const float *fields = reinterpret_cast<const float*>(this->data());
+  packed_.resize(nValues);
+
+  float maxAbs = 0.0;
+#pragma omp parallel for reduction(max:maxAbs)
+  for (long i = 0; i < nValues; ++i) {
+    maxAbs = std::max(maxAbs, std::abs(fields[i]));
+  }
+  peak = maxAbs;
+
+  if (storage == Storage::INT16) {
+    scale_ = (maxAbs > 0.0) ? maxAbs / 32767 : 1.0;
+  }
+
+  float maxError = 0.0;
+
+#pragma omp parallel for reduction(max:maxError)
+  for (long i = 0; i < nValues; ++i) {
+    float decoded;
+
+    if (storage == Storage::FLOAT16) {
+      packed_[i] = HalfFloat::fromFloat(fields[i]);
+      decoded = HalfFloat::toFloat(packed_[i]);
+    } else {
+      int16_t quantised = static_cast<int16_t>(std::lround(fields[i] / scale_));
+      packed_[i] = static_cast<uint16_t>(quantised);
+      decoded = scale_ * quantised;
+    }
+
+    maxError = std::max(maxError, std::abs(decoded - fields[i]));
+  }
+
+  storage_ = storage;
+  this->free();  // Let go of the 32-bit field
+
+  return maxError;
+}
+
+void Electrode::addTo(VectorField &field, float weight) {
+  if (storage_ == Storage::FLOAT32 && !source_ && support_.nPoints() == field.numElements()) {  // Not cropped
+    field += (*this) * weight;
+    return;
+  }
+
+#pragma omp parallel for
+  for (int x = support_.x0; x <= support_.x1; ++x) {
+    for (int y = support_.y0; y <= support_.y1; ++y) {
+      for (int z = support_.z0; z <= support_.z1; ++z) {
+        field(x, y, z) += weight * fieldAt(x, y, z);
+      }
+    }
+  }
 }
@@ -8,8 +8,13 @@
 #pragma once
 
 #include <blitz/tinyvec2.h>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "GridBox.h"
+#include "HalfFloat.h"
 #include "VectorField.h"
 #include "SubConfig.h"
 
@@ -23,9 +28,78 @@
  * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
  */
 class Electrode : public VectorField {
+ public:
+  /** @brief The ways that an Electrode can store its field */
+  enum class Storage {
+    FLOAT32, //!< In the Blitz++ array, as 32-bit floats
+    FLOAT16, //!< Packed as half precision floats
+    INT16 //!< Packed as 16-bit integers with a per-electrode scale
+  };
+
  protected:
   int electrodeNumber_; //!< The number/index of the electrode within the accelerator geometry.
   float currentVoltage_ = 1.0; //!< The voltage that is currently being applied to the electrode
+
+  Storage storage_ = Storage::FLOAT32; //!< How the field is stored
+  std::vector<uint16_t> packed_; //!< The packed field (3 per point, z varying fastest), if it isn't stored as 32-bit floats
+  float scale_ = 1.0; //!< The field represented by one unit of an INT16-packed value
+  ///@{ @brief The dimensions of the packed field
+  int sizeX_ = 0, sizeY_ = 0, sizeZ_ = 0;  ///@}
+  GridBox support_; //!< The part of the grid where the field is stored; it's taken to be zero everywhere else
+
+  std::shared_ptr<Electrode> source_; //!< The Electrode that this one is an image of (null if it stores its own field)
+  int quarterTurns_ = 0; //!< The number of 90 degree turns (anticlockwise about the z-axis) that map source_ onto this Electrode
+  int zShift_ = 0; //!< How far along z (grid points) source_ is moved, after turning, to map it onto this Electrode
+  int rotationSize_ = 0; //!< The size of the (square) x-y grid that the turns are about
+  int imageDepth_ = 0; //!< The size of the grid along z, which the moved image is clipped to
+
+  /** @brief The base field at a point, from this Electrode's own storage
+   *
+   * @see fieldAt()
+   */
+  inline blitz::TinyVector<float, 3> storedFieldAt(int x, int y, int z) const {
+    if (storage_ == Storage::FLOAT32) {
+      return (*this)(x, y, z);
+    }
+
+    const uint16_t *packed = packed_.data()
+        + 3 * ((static_cast<size_t>(x - support_.x0) * sizeY_ + (y - support_.y0)) * sizeZ_ + (z - support_.z0));
+
+    if (storage_ == Storage::FLOAT16) {
+      return blitz::TinyVector<float, 3>(HalfFloat::toFloat(packed[0]), HalfFloat::toFloat(packed[1]),
+                                         HalfFloat::toFloat(packed[2]));
+    }
+
+    return blitz::TinyVector<float, 3>(scale_ * static_cast<int16_t>(packed[0]), scale_ * static_cast<int16_t>(packed[1]),
+                                       scale_ * static_cast<int16_t>(packed[2]));
+  }
+
+  /** @brief The base field at a point, found by moving the source Electrode's field
+   *
+   * The point is moved back onto the source, and the field there is turned forward again.
+   *
+   * @see fieldAt()
+   */
+  inline blitz::TinyVector<float, 3> imageFieldAt(int x, int y, int z) const {
+    int last = rotationSize_ - 1;
+    blitz::TinyVector<float, 3> field;
+    z -= zShift_;
+
+    switch (quarterTurns_) {
+      case 1:
+        field = source_->storedFieldAt(y, last - x, z);
+        return blitz::TinyVector<float, 3>(-field(1), field(0), field(2));
+      case 2:
+        field = source_->storedFieldAt(last - x, last - y, z);
+        return blitz::TinyVector<float, 3>(-field(0), -field(1), field(2));
+      case 3:
+        field = source_->storedFieldAt(last - y, x, z);
+        return blitz::TinyVector<float, 3>(field(1), -field(0), field(2));
+      default:
+        return source_->storedFieldAt(x, y, z);
+    }
+  }
+
  public:
   /** @brief Blank constructor */
   Electrode();
@@ -41,17 +115,18 @@ class Electrode : public VectorField {
    */
   Electrode(const Electrode &elec);
 
-  /** @brief Imports the E-Field files associated with this electrode
+  /** @brief Makes the Electrode a view onto fields that are stored elsewhere
    *
-   * Stores them as the base field of the Electrode. By convention, this is the field when the Electrode has
-   * a PD of 1V applied to it. As such, any other voltage can be obtained by multiplying the field by a scalar.
+   * Used for memory-mapped fields (eg from a FieldCache). The Electrode doesn't own the memory, so it must outlive the Electrode.
    *
-   * @param config Relevant AcceleratorConfig, usually provided by ConfigLoader
+   * @param fields The first of x * y * z field vectors, laid out like a Blitz++ array (z varying fastest)
+   * @param x The size of the field along x
+   * @param y The size of the field along y
+   * @param z The size of the field along z
    *
-   * @see ConfigLoader
-   * @see AcceleratorConfig
+   * @see FieldCache
    */
-  void import(std::shared_ptr<AcceleratorConfig> config);
+  void attach(blitz::TinyVector<float, 3> *fields, int x, int y, int z);
 
   /** @brief Applies a voltage to the Electrode
    *
@@ -66,5 +141,114 @@ class Electrode : public VectorField {
    * @return The voltage that is currently applied to this Electrode
    */
   float getVoltage();
+
+  /** @brief How far this Electrode's field is from being a moved copy of another's
+   *
+   * Both Electrodes must hold their whole (32-bit) fields, and the grid must be square in x-y if there are any turns.
+   * Where the moved field would come from outside the grid, this field is compared with zero.
+   *
+   * @param source The Electrode to move
+   * @param quarterTurns The number of 90 degree turns, anticlockwise about the z-axis
+   * @param zShift How far to move the turned field along z (grid points)
+   * @return The largest difference between this field and the moved one, as a fraction of this field's peak |E|
+   */
+  float imageError(const Electrode &source, int quarterTurns, int zShift = 0) const;
+
+  /** @brief Makes the Electrode an image of another, turned about the z-axis and then moved along it
+   *
+   * Its own field is released, and fieldAt() moves the source's field instead. Nothing is checked, so use imageError()
+   * first. Cropping or packing an image does nothing to its field (the source's storage is used), but crop() must still be
+   * called after the source is cropped, to update the image's support.
+   *
+   * @param source The Electrode to move, which must store its own field
+   * @param quarterTurns The number of 90 degree turns, anticlockwise about the z-axis
+   * @param zShift How far to move the turned field along z (grid points)
+   */
+  void makeImage(std::shared_ptr<Electrode> source, int quarterTurns, int zShift = 0);
+
+  /** @brief The Electrode that this one is an image of
+   *
+   * @return The source Electrode, or null if this one stores its own field
+   */
+  std::shared_ptr<Electrode> source() const;
+
+  /** @brief Whether the Electrode is an image of another rather than storing its own field
+   *
+   * @return true if the Electrode is an image
+   */
+  bool isImage() const;
+
+  /** @brief Throws away the field where it's negligible
+   *
+   * Finds the smallest box containing every point where |E| is more than cutoff times its peak, and keeps the field in that
+   * box only. The box indices are unchanged (the Blitz++ array just gets a non-zero base), so the Electrode is still
+   * indexed with grid coordinates. Must be done before pack().
+   *
+   * @param cutoff The fraction of the peak |E| below which the field is negligible (0 keeps the whole grid)
+   * @param shrink Whether to move the field into an array the size of the box. If not (eg when the field is in shared
+   * memory, which a private copy would defeat), the support is still found and only the memory is kept as it is
+   */
+  void crop(float cutoff, bool shrink = true);
+
+  /** @brief The part of the grid where the field is stored
+   *
+   * The field is zero outside this box. Unless the Electrode has been cropped, this is the whole grid.
+   *
+   * @return The box of grid points
+   */
+  const GridBox& support() const;
+
+  /** @brief Packs the field into a smaller storage format
+   *
+   * The 32-bit field is released afterwards. FLOAT16 halves the memory used, and so does INT16, which stores every value
+   * as a multiple of a per-electrode scale (the largest component / 32767).
+   *
+   * @param storage The storage format to use
+   * @param[out] peak The largest field component (V/m), for putting the error in context
+   * @return The largest error in any field component that the packing causes (V/m)
+   */
+  float pack(Storage storage, float &peak);
+
+  /** @brief Parses the name of a storage format
+   *
+   * @param name "float32", "float16" or "int16"
+   * @return The corresponding storage format
+   */
+  static Storage storageFromName(const std::string &name);
+
+  /** @brief How the field is stored
+   *
+   * @return The storage format of the field
+   */
+  Storage storage() const;
+
+  /** @brief The memory used by the field
+   *
+   * @return The size of the stored field (bytes)
+   */
+  size_t fieldBytes() const;
+
+  /** @brief Adds this Electrode's field, times a weight, to a VectorField
+   *
+   * Works whatever the storage format.
+   *
+   * @param field The VectorField to add to (the same size as the Electrode)
+   * @param weight What to multiply the field by (usually the voltage)
+   */
+  void addTo(VectorField &field, float weight);
+
+  /** @brief The base (1V) field at a point, whatever the storage format
+   *
+   * This is what SmartField sums over, so packed fields are decoded here as they're loaded, and images are moved here. The point must be inside
+   * support(); callers skip the Electrode (whose field is zero) otherwise.
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @return A TinyVector of the base field at the given point
+   */
+  inline blitz::TinyVector<float, 3> fieldAt(int x, int y, int z) const {
+    return (source_) ? imageFieldAt(x, y, z) : storedFieldAt(x, y, z);
+  }
 };
 
@@ -0,0 +1,52 @@
+#include "ElectrodeLoader.h"
+
+#include <chrono>
+
+#include "Electrode.h"
+#include "FieldCache.h"
+#include "SubConfig.h"
+
+ElectrodeLoader::ElectrodeLoader(std::shared_ptr<AcceleratorConfig> config, std::shared_ptr<FieldCache> cache)
+    : config_(config),
+      cache_(cache),
+      loads_(config->nElectrodes()) {
+}
+
+std::shared_ptr<Electrode> ElectrodeLoader::load(int e) const {
+  std::shared_ptr<Electrode> electrode = std::make_shared<Electrode>(e + 1);
+
+  cache_->prefetch(e);
+  electrode->attach(const_cast<blitz::TinyVector<float, 3>*>(cache_->fields(e)), config_->x(), config_->y(), config_->z());
+  electrode->crop(config_->supportCutoff());  // Copies the field into memory if there's a cutoff
+
+  float peak;
+  electrode->pack(Electrode::storageFromName(config_->basisStorage()), peak);
+
+  return electrode;
+}
+
+void ElectrodeLoader::prefetch(int e) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (!loads_[e].valid()) {
+    loads_[e] = std::async(std::launch::async, &ElectrodeLoader::load, this, e).share();
+  }
+}
+
+bool ElectrodeLoader::isLoaded(int e) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return loads_[e].valid() && loads_[e].wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::shared_ptr<Electrode> ElectrodeLoader::get(int e) {
+  prefetch(e);
+
+  std::shared_future<std::shared_ptr<Electrode> > electrode;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    electrode = loads_[e];
+  }
+
+  return electrode.get();
+}
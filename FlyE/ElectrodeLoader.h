@@ -0,0 +1,68 @@
+/**@file ElectrodeLoader.h
+ * @brief This file contains the ElectrodeLoader class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class AcceleratorConfig;
+class Electrode;
+class FieldCache;
+
+/** @brief Loads Electrodes from a FieldCache in background threads, as they're needed
+ *
+ * Used for lazy loading: the simulation starts with empty Electrodes, and each one is loaded (and cropped and packed, as
+ * configured) shortly before it's first given a voltage. Each Electrode is only ever loaded once, and the loaded
+ * Electrodes are new objects, so nothing that's in use by a SmartField is changed underneath it.
+ *
+ * @see AcceleratorGeometry
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class ElectrodeLoader {
+ protected:
+  std::shared_ptr<AcceleratorConfig> config_; //!< The configuration of the geometry
+  std::shared_ptr<FieldCache> cache_; //!< The (loaded) field cache that the Electrodes come from
+  std::vector<std::shared_future<std::shared_ptr<Electrode> > > loads_; //!< The load of each Electrode, if it's been started
+  std::mutex mutex_; //!< Guards loads_
+
+  /** @brief Loads one Electrode (run in a background thread)
+   *
+   * @param e The index of the Electrode
+   * @return The loaded Electrode
+   */
+  std::shared_ptr<Electrode> load(int e) const;
+
+ public:
+  /** @brief Constructs a loader for the given geometry
+   *
+   * @param config The configuration of the geometry
+   * @param cache A loaded FieldCache for the geometry
+   */
+  ElectrodeLoader(std::shared_ptr<AcceleratorConfig> config, std::shared_ptr<FieldCache> cache);
+
+  /** @brief Starts loading an Electrode in the background, if it hasn't been already
+   *
+   * @param e The index of the Electrode
+   */
+  void prefetch(int e);
+
+  /** @brief Whether an Electrode has finished loading
+   *
+   * @param e The index of the Electrode
+   * @return true if get() would return straight away
+   */
+  bool isLoaded(int e);
+
+  /** @brief Gets a loaded Electrode, loading it (and waiting for it) first if necessary
+   *
+   * @param e The index of the Electrode
+   * @return The loaded Electrode
+   */
+  std::shared_ptr<Electrode> get(int e);
+};
@@ -1,4 +1,7 @@
 #include "ElectrodeLocator.h"
+
+#include <algorithm>
+
 #include "Electrode.h"
 
 ElectrodeLocator::ElectrodeLocator(Electrode &electrode)
@@ -9,6 +12,11 @@ ElectrodeLocator::ElectrodeLocator(std::shared_ptr<Electrode> electrode)
     : blitz::Array<bool, 3>(!electrode->extractComponent(float(), 1, 3)) {
 }
 
+ElectrodeLocator::ElectrodeLocator(const bool *locations, int x, int y, int z)
+    : blitz::Array<bool, 3>(x, y, z) {
+  std::copy(locations, locations + this->numElements(), this->data());
+}
+
 bool ElectrodeLocator::existsAt(int x, int y, int z) {
   return this->operator()(x, y, z);
 }
@@ -34,6 +34,17 @@ class ElectrodeLocator : public blitz::Array<bool, 3> {
    */
   ElectrodeLocator(std::shared_ptr<Electrode> electrode);
 
+  /** @brief Constructs an ElectrodeLocator from stored locations (eg in a FieldCache)
+   *
+   * The locations are copied.
+   *
+   * @param locations The first of x * y * z bools, laid out like a Blitz++ array (z varying fastest)
+   * @param x The size of the geometry along x
+   * @param y The size of the geometry along y
+   * @param z The size of the geometry along z
+   */
+  ElectrodeLocator(const bool *locations, int x, int y, int z);
+
   /**
    * @brief Checks to see if the electrode exists at a given point
    * @param x x-coordinate to check
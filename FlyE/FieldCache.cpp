@@ -0,0 +1,212 @@
+#include "FieldCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Electrode.h"
+#include "ElectrodeLocator.h"
+#include "PhysicalConstants.h"
+#include "SubConfig.h"
+
+namespace {
+
+constexpr char MAGIC[8] = "FLYEFC"; // Padded with nulls
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+// FNV-1a, continuing from hash
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+}
+
+FieldCache::FieldCache(std::shared_ptr<AcceleratorConfig> config)
+    : config_(config),
+      checksum_(sourceChecksum(config)) {
+}
+
+uint64_t FieldCache::sourceChecksum(std::shared_ptr<AcceleratorConfig> config) {
+  std::vector<std::string> paths;
+
+  if (config->solveLaplace()) paths.push_back(config->paGeometryPath());
+
+  for (int e = 1; e <= config->nElectrodes() && !config->solveLaplace(); ++e) {
+    if (!config->paDirectory().empty()) {
+      paths.push_back(config->paPath(e));
+      continue;
+    }
+
+    for (int x = 0; x < config->x(); ++x) {
+      for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+        paths.push_back(config->datPath(e, x, d));
+      }
+    }
+  }
+
+  uint64_t hash = FNV_OFFSET;
+  bool foundAny = false;
+
+  for (auto &path : paths) {
+    hash = fnv1a(path.data(), path.size(), hash);
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) continue;  // A missing file still changes the hash via its name
+
+    foundAny = true;
+    int64_t size = info.st_size;
+    int64_t modified = info.st_mtime;
+    hash = fnv1a(&size, sizeof(size), hash);
+    hash = fnv1a(&modified, sizeof(modified), hash);
+  }
+
+  if (config->solveLaplace() || !config->paDirectory().empty()) {  // The fields from a .pa file scale with its pixel size
+    double pixelSize = config->paPixelSize();
+    hash = fnv1a(&pixelSize, sizeof(pixelSize), hash);
+  }
+
+  if (config->solveLaplace()) {  // A tighter tolerance should solve the fields again
+    double tolerance = config->laplaceTolerance();
+    hash = fnv1a(&tolerance, sizeof(tolerance), hash);
+  }
+
+  return (foundAny) ? hash : 0;
+}
+
+std::string FieldCache::path() const {
+  return (config_->fieldCache().empty()) ?
+      config_->datDirectory() + config_->PAname() + ".fcache" : config_->fieldCache();
+}
+
+void FieldCache::makeHeader(FieldCacheHeader &header) const {
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+
+  header.version = VERSION;
+  header.nElectrodes = config_->nElectrodes();
+  header.x = config_->x();
+  header.y = config_->y();
+  header.z = config_->z();
+  std::strncpy(header.PAname, config_->PAname().c_str(), sizeof(header.PAname) - 1);
+  header.checksum = checksum_;
+  header.dataOffset = ALIGNMENT;
+}
+
+bool FieldCache::matches(const FieldCacheHeader &header) const {
+  FieldCacheHeader expected;
+  makeHeader(expected);
+
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+      || header.version != expected.version
+      || header.nElectrodes != expected.nElectrodes
+      || header.x != expected.x || header.y != expected.y || header.z != expected.z
+      || std::strncmp(header.PAname, expected.PAname, sizeof(header.PAname)) != 0) {
+    return false;
+  }
+
+  if (checksum_ == 0) {  // Nothing to check against, so trust the cache
+    std::cout << "No source files found for " << config_->PAname() << "; trusting the cached fields" << std::endl;
+    return true;
+  }
+
+  return header.checksum == checksum_;
+}
+
+bool FieldCache::load() {
+  file_.reset(new MappedFile(path()));
+
+  if (!file_->isOpen() || file_->size() < sizeof(FieldCacheHeader)) {
+    file_.reset();
+    return false;
+  }
+
+  const FieldCacheHeader &header = *reinterpret_cast<const FieldCacheHeader*>(file_->data());
+  uint64_t nPoints = static_cast<uint64_t>(header.x) * header.y * header.z;
+  uint64_t fieldBytes = sizeof(float) * Physics::N_DIMENSIONS * nPoints;
+
+  if (!matches(header) || file_->size() < header.dataOffset + header.nElectrodes * fieldBytes
+      || (header.locatorOffset != 0 && file_->size() < header.locatorOffset + nPoints * sizeof(bool))) {
+    std::cout << "Field cache " << path() << " is stale; re-importing" << std::endl;
+    file_.reset();
+    return false;
+  }
+
+  return true;
+}
+
+const blitz::TinyVector<float, 3>* FieldCache::fields(int e) const {
+  const FieldCacheHeader &header = *reinterpret_cast<const FieldCacheHeader*>(file_->data());
+  size_t nPoints = static_cast<size_t>(header.x) * header.y * header.z;
+
+  return reinterpret_cast<const blitz::TinyVector<float, 3>*>(file_->data() + header.dataOffset) + e * nPoints;
+}
+
+const bool* FieldCache::locations() const {
+  const FieldCacheHeader &header = *reinterpret_cast<const FieldCacheHeader*>(file_->data());
+
+  return (header.locatorOffset == 0) ? nullptr : reinterpret_cast<const bool*>(file_->data() + header.locatorOffset);
+}
+
+void FieldCache::prefetch(int e) const {
+  size_t fieldBytes = sizeof(blitz::TinyVector<float, 3>) * config_->x() * config_->y() * config_->z();
+
+  file_->prefetch(reinterpret_cast<const char*>(fields(e)) - file_->data(), fieldBytes);
+}
+
+void FieldCache::attach(std::vector<std::shared_ptr<Electrode> > &electrodes) {
+  for (unsigned int e = 0; e < electrodes.size(); ++e) {
+    // The mapping is read-only; Blitz++ just doesn't have a const view
+    electrodes[e]->attach(const_cast<blitz::TinyVector<float, 3>*>(fields(e)),
+                          config_->x(), config_->y(), config_->z());
+  }
+}
+
+uint64_t FieldCache::checksum() const {
+  return checksum_;
+}
+
+bool FieldCache::write(const std::vector<std::shared_ptr<Electrode> > &electrodes,
+                       const ElectrodeLocator &locator) const {
+  std::string tempPath = path() + ".tmp" + std::to_string(getpid());
+  std::ofstream cacheFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+
+  if (cacheFile.fail()) {
+    std::cout << "Error writing field cache: " << tempPath << std::endl;
+    return false;
+  }
+
+  FieldCacheHeader header;
+  makeHeader(header);
+  header.locatorOffset = header.dataOffset
+      + electrodes.size() * electrodes[0]->numElements() * sizeof(blitz::TinyVector<float, 3>);
+
+  std::vector<char> padding(header.dataOffset - sizeof(header), 0);
+  cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  cacheFile.write(padding.data(), padding.size());
+
+  for (auto &electrode : electrodes) {
+    cacheFile.write(reinterpret_cast<const char*>(electrode->data()),
+                    electrode->numElements() * sizeof(blitz::TinyVector<float, 3>));
+  }
+
+  cacheFile.write(reinterpret_cast<const char*>(locator.data()), locator.numElements() * sizeof(bool));
+
+  cacheFile.close();
+
+  if (cacheFile.fail() || std::rename(tempPath.c_str(), path().c_str()) != 0) {
+    std::cout << "Error writing field cache: " << path() << std::endl;
+    std::remove(tempPath.c_str());
+    return false;
+  }
+
+  std::cout << "Wrote field cache " << path() << std::endl;
+  return true;
+}
@@ -0,0 +1,144 @@
+/**@file FieldCache.h
+ * @brief This file contains the FieldCache class and the FieldCacheHeader struct
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <blitz/tinyvec2.h>
+
+#include "MappedFile.h"
+
+class AcceleratorConfig;
+class Electrode;
+class ElectrodeLocator;
+
+/** @brief The header at the start of every binary field cache file
+ *
+ * The electrode fields follow at dataOffset, one after another in electrode order. Each one is stored exactly as
+ * it is laid out in memory by Blitz++: x * y * z TinyVector<float, 3>s, with z varying fastest. The electrode locations
+ * (one bool per point, laid out the same way) follow the fields, at locatorOffset.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+struct FieldCacheHeader {
+  char magic[8]; //!< Always "FLYEFC" (null padded)
+  uint32_t version; //!< Version of the file layout
+  uint32_t nElectrodes; //!< Number of electrodes stored
+  ///@{ @brief x, y, z dimensions of each electrode's field
+  int32_t x, y, z;  ///@}
+  char PAname[64]; //!< The PA name of the geometry (null terminated)
+  uint64_t checksum; //!< Checksum of the source (.dat or .pa) files the fields were imported from
+  uint64_t dataOffset; //!< Offset of the first electrode's field from the start of the file (bytes)
+  uint64_t locatorOffset; //!< Offset of the electrode locations from the start of the file (bytes), or 0 if there are none
+};
+
+/** @brief A compact binary cache of the imported electrode fields
+ *
+ * The first time a geometry is imported from its .dat files, the fields are written to the cache. On later runs the cache is
+ * memory-mapped read-only and the Electrodes become views onto it, so there is nothing to parse and the OS page cache is
+ * shared between every run (and every process) that uses the geometry.
+ *
+ * The cache is only used if its dimensions, PA name, number of electrodes and source checksum all match the configuration.
+ * The checksum is built from the names, sizes and modification times of the .dat (or .pa) files, so it is cheap to compute but
+ * still notices if the fields are regenerated.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class FieldCache {
+ protected:
+  std::shared_ptr<AcceleratorConfig> config_; //!< The configuration of the geometry being cached
+  std::unique_ptr<MappedFile> file_; //!< The mapped cache file (once loaded)
+  uint64_t checksum_; //!< Checksum of the geometry's source files, computed on construction
+
+ public:
+  static constexpr uint32_t VERSION = 2; //!< The current version of the file layout
+  static constexpr uint64_t ALIGNMENT = 4096; //!< Alignment of the field data in the file (one page)
+
+  /** @brief Constructs a FieldCache for the given geometry
+   *
+   * @param config The configuration of the geometry
+   */
+  FieldCache(std::shared_ptr<AcceleratorConfig> config);
+
+  /** @brief Maps the cache file and checks that it matches the configuration
+   *
+   * @return true if the cache can be used, false if it doesn't exist or is stale
+   */
+  bool load();
+
+  /** @brief Makes the Electrodes views onto the mapped fields
+   *
+   * The mapping is read-only, so the Electrodes mustn't be written to afterwards. The FieldCache must outlive them.
+   *
+   * @param electrodes The (empty) Electrodes to attach, in order
+   */
+  void attach(std::vector<std::shared_ptr<Electrode> > &electrodes);
+
+  /** @brief The mapped field of one electrode (once loaded)
+   *
+   * @param e The index of the electrode
+   * @return The first of the electrode's x * y * z field vectors
+   */
+  const blitz::TinyVector<float, 3>* fields(int e) const;
+
+  /** @brief The mapped electrode locations (once loaded)
+   *
+   * @return The first of x * y * z bools, laid out like a Blitz++ array, or nullptr if the cache doesn't have them
+   */
+  const bool* locations() const;
+
+  /** @brief Asks the OS to start reading one electrode's mapped field into memory
+   *
+   * @param e The index of the electrode
+   */
+  void prefetch(int e) const;
+
+  /** @brief Checksum of the geometry's source files
+   *
+   * @return The checksum that was computed on construction
+   */
+  uint64_t checksum() const;
+
+  /** @brief The path of the cache file for this geometry
+   *
+   * @return The configured path, or [dat_directory][pa_name].fcache if none was given
+   */
+  std::string path() const;
+
+  /** @brief Writes imported Electrodes, and where they are, to the cache file
+   *
+   * The file is written to a temporary path and renamed, so other processes never see a partial cache.
+   *
+   * @param electrodes The imported Electrodes, in order (with their whole 32-bit fields)
+   * @param locator The locations of all of the Electrodes
+   * @return true if the cache was written
+   */
+  bool write(const std::vector<std::shared_ptr<Electrode> > &electrodes, const ElectrodeLocator &locator) const;
+
+  /** @brief Fills in a header describing the configured geometry
+   *
+   * @param header The header to fill
+   */
+  void makeHeader(FieldCacheHeader &header) const;
+
+  /** @brief Checks a header against the configured geometry
+   *
+   * @param header A header read from a cache
+   * @return true if the header describes this geometry
+   */
+  bool matches(const FieldCacheHeader &header) const;
+
+  /** @brief Checksum of the source files (.dat, or .pa if a .pa directory is configured) for the configured geometry
+   *
+   * @param config The configuration of the geometry
+   * @return An FNV-1a hash of the name, size and modification time of every file (and the .pa pixel size, if the fields
+   *         are derived from .pa files, and the Laplace solver's tolerance if it's used), or 0 if none of them exist
+   */
+  static uint64_t sourceChecksum(std::shared_ptr<AcceleratorConfig> config);
+};
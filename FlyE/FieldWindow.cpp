@@ -0,0 +1,118 @@
+#include "FieldWindow.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PhysicalConstants.h"
+
+FieldWindow::FieldWindow(int x, int y, int z, int margin)
+    : grid_(0, 0, 0, x - 1, y - 1, z - 1),
+      margin_(std::max(margin, 1)) {
+}
+
+void FieldWindow::invalidate() {
+  stale_ = true;
+}
+
+bool FieldWindow::covers(const GridBox &particles) const {
+  // Particles entirely off the grid clip to an empty box, which any box "contains", but there's nothing for them here
+  GridBox needed = particles.grown(1, grid_);
+  return !stale_ && !needed.empty() && box_.contains(needed);
+}
+
+void FieldWindow::place(const GridBox &particles) {
+  box_ = particles.grown(margin_, grid_);
+  if (box_.empty()) box_ = GridBox();  // Off the grid, so no window (rather than a back-to-front one)
+  tile_ = box_.grown(1, grid_);
+
+  // assign() keeps the capacity, so the tile is only reallocated when it grows
+  field_.assign(3 * tile_.nPoints(), 0.0);
+  magnitudes_.resize(tile_.nPoints());
+  for (auto &gradient : gradients_) {
+    gradient.resize(tile_.nPoints());
+  }
+
+  stale_ = true;
+}
+
+const GridBox& FieldWindow::tile() const {
+  return tile_;
+}
+
+void FieldWindow::finish() {
+  const long nPoints = tile_.nPoints();
+
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < nPoints; ++i) {
+    magnitudes_[i] = std::sqrt(field_[3 * i] * field_[3 * i] + field_[3 * i + 1] * field_[3 * i + 1]
+                               + field_[3 * i + 2] * field_[3 * i + 2]);
+  }
+
+  const float scale = 0.5 * Physics::MM_M_FACTOR;
+  const int rowLength = tile_.z1 - tile_.z0 + 1;
+  const std::vector<float> zeros(rowLength, 0.0);  // The magnitudes just outside the grid
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int x = box_.x0; x <= box_.x1; ++x) {
+    for (int y = box_.y0; y <= box_.y1; ++y) {
+      const float *centre = &magnitudes_[index(x, y, tile_.z0)];
+      const float *left = (x > tile_.x0) ? &magnitudes_[index(x - 1, y, tile_.z0)] : zeros.data();
+      const float *right = (x < tile_.x1) ? &magnitudes_[index(x + 1, y, tile_.z0)] : zeros.data();
+      const float *below = (y > tile_.y0) ? &magnitudes_[index(x, y - 1, tile_.z0)] : zeros.data();
+      const float *above = (y < tile_.y1) ? &magnitudes_[index(x, y + 1, tile_.z0)] : zeros.data();
+      float *gradientX = &gradients_[0][index(x, y, tile_.z0)];
+      float *gradientY = &gradients_[1][index(x, y, tile_.z0)];
+      float *gradientZ = &gradients_[2][index(x, y, tile_.z0)];
+
+      for (int k = box_.z0 - tile_.z0; k <= box_.z1 - tile_.z0; ++k) {
+        gradientX[k] = scale * (right[k] - left[k]);
+        gradientY[k] = scale * (above[k] - below[k]);
+        gradientZ[k] = scale * (((k < rowLength - 1) ? centre[k + 1] : 0.0f) - ((k > 0) ? centre[k - 1] : 0.0f));
+      }
+    }
+  }
+
+  stale_ = false;
+}
+
+void FieldWindow::sample(float x, float y, float z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+  if (box_.empty()) {  // No window to interpolate in
+    magnitude = 0.0;
+    gradient = 0.0;
+    return;
+  }
+
+  // The cell that the point is in, and how far across it the point is
+  int cell[3];
+  float weight[3];
+  const float position[3] = { x, y, z };
+  const int last[3] = { grid_.x1, grid_.y1, grid_.z1 };
+
+  for (int d = 0; d < 3; ++d) {
+    float clamped = std::min(std::max(position[d], 0.0f), static_cast<float>(last[d]));
+    cell[d] = std::min(static_cast<int>(clamped), last[d] - 1);
+    weight[d] = clamped - cell[d];
+  }
+
+  float values[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+  for (int corner = 0; corner < 8; ++corner) {
+    int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+    float w = ((dx) ? weight[0] : 1 - weight[0]) * ((dy) ? weight[1] : 1 - weight[1])
+        * ((dz) ? weight[2] : 1 - weight[2]);
+    size_t i = index(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+
+    values[0] += w * magnitudes_[i];
+    values[1] += w * gradients_[0][i];
+    values[2] += w * gradients_[1][i];
+    values[3] += w * gradients_[2][i];
+  }
+
+  magnitude = values[0];
+  gradient = blitz::TinyVector<float, 3>(values[1], values[2], values[3]);
+}
+
+size_t FieldWindow::size() const {
+  return sizeof(float) * (field_.capacity() + magnitudes_.capacity() + gradients_[0].capacity()
+      + gradients_[1].capacity() + gradients_[2].capacity());
+}
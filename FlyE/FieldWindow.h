@@ -0,0 +1,124 @@
+/**@file FieldWindow.h
+ * @brief This file contains the FieldWindow class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <vector>
+
+#include <blitz/tinyvec2.h>
+
+#include "GridBox.h"
+
+/** @brief The field, its magnitude and its gradient in a box around the particles
+ *
+ * The particles only ever fill a short stretch of the accelerator, so rather than keeping the field everywhere, a
+ * SmartField can keep it in a window: the box around the live particles, plus a margin. The window is one contiguous tile
+ * (with z varying fastest) which is reused from step to step, so its working set stays the same size however long the
+ * accelerator is. The tile holds the superposed field one point further out than the window, so that the gradients at the
+ * window's edges are the same central differences as GradientField's (with the field taken to be zero outside the grid).
+ *
+ * The window is placed with place(), filled in by the SmartField through fieldAt(), and then finish() works out the
+ * magnitudes and gradients. It stays where it is until the particles get within a point of its edge, or the field changes.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class FieldWindow {
+ protected:
+  GridBox grid_; //!< The whole grid
+  int margin_; //!< How many points to leave around the particles when the window is placed
+  GridBox box_; //!< Where the magnitudes and gradients are known
+  GridBox tile_; //!< Where the field is superposed (the window plus a point either side, within the grid)
+  bool stale_ = true; //!< Whether the field has changed since the window was filled
+  std::vector<float> field_; //!< The three components of the field at each point of the tile
+  std::vector<float> magnitudes_; //!< The magnitude at each point of the tile
+  std::vector<float> gradients_[3]; //!< The gradient in x, y and z at each point of the tile (only set in the window)
+
+  /** @brief The index of a point (which must be in the tile) in the tile's arrays */
+  inline size_t index(int x, int y, int z) const {
+    return (static_cast<size_t>(x - tile_.x0) * (tile_.y1 - tile_.y0 + 1) + (y - tile_.y0)) * (tile_.z1 - tile_.z0 + 1)
+        + (z - tile_.z0);
+  }
+
+ public:
+  /** @brief Makes an empty (stale) window for a grid
+   *
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   * @param margin How many points to leave around the particles when the window is placed
+   */
+  FieldWindow(int x, int y, int z, int margin);
+
+  /** @brief Marks the window as stale, so that it's refilled the next time it's placed */
+  void invalidate();
+
+  /** @brief Whether the window is up to date and has room for some particles
+   *
+   * @param particles The grid points that the particles are between (they'll also be looked up a point further out)
+   * @return true if the window can be used as it is (never if the particles are all off the grid)
+   */
+  bool covers(const GridBox &particles) const;
+
+  /** @brief Moves the window to around some particles, and zeroes the tile to be filled with fieldAt()
+   *
+   * The tile's memory is kept from place to place, and only grows if the window does. If the particles are all off the
+   * grid, there's no window: the tile is empty, and every lookup is 0 until it's placed again.
+   *
+   * @param particles The grid points that the particles are between
+   */
+  void place(const GridBox &particles);
+
+  /** @brief Where the field has to be filled in, after place() */
+  const GridBox& tile() const;
+
+  /** @brief The field at a point of the tile, to be filled in
+   *
+   * @param x x-coordinate of the point (which must be in tile())
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @return A pointer to the point's three components, with the rest of the z-row after them
+   */
+  inline float* fieldAt(int x, int y, int z) {
+    return &field_[3 * index(x, y, z)];
+  }
+
+  /** @brief Works out the magnitudes and gradients in the window once the tile is filled, and marks it up to date */
+  void finish();
+
+  /** @brief The magnitude of the field and its gradient at a grid point
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param[out] magnitude The magnitude of the field at the point (0 outside the window)
+   * @param[out] gradient The gradient of the magnitude at the point (0 outside the window)
+   */
+  inline void nodeAt(int x, int y, int z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+    if (!box_.contains(x, y, z)) {
+      magnitude = 0.0;
+      gradient = 0.0;
+      return;
+    }
+
+    size_t i = index(x, y, z);
+    magnitude = magnitudes_[i];
+    gradient = blitz::TinyVector<float, 3>(gradients_[0][i], gradients_[1][i], gradients_[2][i]);
+  }
+
+  /** @brief Interpolates the magnitude and its gradient at a point, whose cell must be in the window (0 if there's no window)
+   *
+   * @see GradientField::sample()
+   *
+   * @param x x-coordinate of the point (grid spacings)
+   * @param y y-coordinate of the point (grid spacings)
+   * @param z z-coordinate of the point (grid spacings)
+   * @param[out] magnitude The magnitude of the field at the point
+   * @param[out] gradient The gradient of the magnitude at the point
+   */
+  void sample(float x, float y, float z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const;
+
+  /** @brief The memory that the tile is using (bytes) */
+  size_t size() const;
+};
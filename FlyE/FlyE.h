@@ -27,6 +27,7 @@
  * * `-fopenmp`
  * * `-lblitz`
  * * `-lpthread`
+ * * `-lrt`
  * * `-lconfig++`
  *
  * The following optimisations are recommended:
@@ -77,6 +78,22 @@
  *   * `x/y/z` - The size of the geometry (from the electric field files) in each direction (integer).
  *   * `dat_directory` - The directory in whih the electric field files are stored (string).
  *   * `pa_name` - The prefix for the naming convention of the electric field files (string).
+ *   * `pa_directory` - The directory in which the SIMION fast adjust files (`[pa_name].pa1`, `[pa_name].pa2` etc) are stored. If this is given, the fields are derived from them directly, and the .dat files aren't needed (string, default none).
+ *   * `solve_laplace` - Whether to solve Laplace's equation for each electrode's field, from the SIMION geometry file (`[pa_directory][pa_name].pa#`), instead of reading the .dat or .pa files. Neither SIMION's refine step nor EXSIMECK are needed (boolean, default false).
+ *   * `laplace_tolerance` - The Laplace solver stops when no potential would change by more than this fraction of the electrode voltage (float, default 1e-6).
+ *   * `pa_pixel_size` - The distance between points in the .pa files, the same as EXSIMECK's `DISTANCE_BETWEEN_PIXELS` (mm, float, default 0.1).
+ *   * `use_field_cache` - Whether to use a binary cache of the imported fields. It is written the first time a geometry is imported and memory-mapped on later runs, unless the source files, `pa_pixel_size` or (with `solve_laplace`) `laplace_tolerance` have changed (boolean, default true).
+ *   * `field_cache` - Path to the binary field cache. Defaults to `[dat_directory][pa_name].fcache` (string).
+ *   * `shared_memory` - Whether to share the imported fields between FlyE processes on the same machine through POSIX shared memory. The first process imports the geometry and publishes it, and the others attach to it read-only. A shared basis isn't packed (`basis_storage`) or copied into cropped arrays (`support_cutoff` still limits where each electrode is summed), since each process would make its own copy (boolean, default false).
+ *   * `shm_name` - Name of the shared memory segment. Defaults to a name made from the PA name, the dimensions and the checksum of the .dat files (string).
+ *   * `basis_storage` - How each electrode stores its field: 'float32', 'float16' (half precision) or 'int16' (scaled per electrode). The 16-bit formats halve the memory used by the geometry and the bandwidth needed to superpose it; the largest error they cause is reported at import (string, default 'float32').
+ *   * `support_cutoff` - Each electrode only keeps its field inside the smallest box where |E| is more than this fraction of its peak, and is skipped everywhere else. Saves memory and time in long accelerators, where most electrodes have no effect on most of the grid (float, default 0, which keeps the whole grid).
+ *   * `rotational_symmetry` - Whether to look for electrodes in the same section that are 90 degree rotations of each other (about the axis of the accelerator), and store only one of them. The rest are rotated as they're used. Needs x and y to be the same (boolean, default false).
+ *   * `periodic` - Whether to look for sections that are the same as the previous section moved along the accelerator, and store them as moved copies. A long accelerator then needs little more memory than one section, as long as the ends of the grid don't change the fields too much. The z size must be a whole number of sections (boolean, default false).
+ *   * `symmetry_tolerance` - The largest difference allowed between an electrode's field and the rotated or moved field that would replace it, as a fraction of its peak (float, default 1e-3).
+ *   * `lazy_loading` - Whether to load each electrode from the field cache in the background, shortly before the voltage scheme first switches it on, rather than loading them all before the simulation starts. Needs an up-to-date field cache, so the first run imports everything as usual. Symmetries aren't used (boolean, default false).
+ *   * `prefetch_sections` - How many sections ahead of the voltage scheme to load electrodes, with lazy loading (integer, default 1).
+ *   * `interleaved_basis` - Whether to keep a second copy of the basis with every electrode's field at a point stored together, so the whole field can be superposed with SIMD (AVX2/AVX-512 FMA) dot products. Voltage changes are resummed from it too, so the field always matches a full superposition exactly. It costs about as much memory as a float32 basis (holding the packed values if `basis_storage` packs them), and isn't used with lazy loading (boolean, default false).
  * * `simulation`
  *   * `time_step` - The time step to use in the simulation (in seconds, float).
  *   * `duration` - The amount of time to run the simulation for (in seconds, float).
@@ -84,6 +101,15 @@
  *   * `target_vel` - The velocity to accelerate the particles to. Only used with the 'trap' acceleration scheme (m/s, float).
  *   * `accel_scheme` - The scheme for voltages to accelerate particles. Can be 'exponential', 'instantaneous' or 'trap' (string).
  *   * `inglis_teller` - Whether to neutralise the electric dipole moment of particles if the field is greater than their Inglis-Teller limit (boolean).
+ *   * `interpolate_field` - Whether to interpolate the field's magnitude and gradient trilinearly at each particle's actual position, instead of using the nearest grid point. Gives smoother forces, so longer time steps can be used (boolean, default false).
+ *   * `field_evaluation` - How to evaluate the field's magnitude and gradient: `lazy` computes and remembers them at each point a particle visits, `dense` recomputes them for the whole slab the particles are in whenever the voltages change, and `auto` picks dense if there are enough particles for it to be cheaper. Interpolation always uses dense evaluation (string, default lazy, which is how the field was always evaluated).
+ *   * `field_window` - Only superpose the field (and its magnitude and gradient) in a window around the live particles, this many grid points bigger than them on every side, which follows them down the accelerator. The window's memory is reused from step to step, so it stays in cache however long the accelerator is. Implies dense evaluation; 0 keeps the field for the whole grid (integer, default 0).
+ *   * `phase_table` - For the trap scheme, tabulate the field's magnitude and gradient for a 1V trap at this many evenly spaced phases, and look them up (interpolating linearly in phase, and scaling by the voltage) instead of blending the field every step. The table is written next to the field cache as [dat_directory][pa_name].ptable and mapped by later runs with the same geometry, whatever their maximum voltage. It takes 16 bytes per grid point per phase, but it's built straight into a file (a temporary one if the field cache is off) and only mapped, so it doesn't have to fit in memory, and the patterns' fields are dropped once it's ready; 32 phases is plenty. Implies dense evaluation, and replaces the field window; 0 turns it off (integer, default 0).
+ *   * `compaction_interval` - Every this many time steps, drop the particles that have collided, ionised or reached the end from the particle loop, so each step only costs as much as the particles still flying. The simulation also stops early once none are left. 0 never drops them (integer, default 100).
+ *   * `sort_interval` - Every this many time steps, sort the particles along a Morton (Z-order) curve through the grid, so that particles that are near each other are handled together and look up the same parts of the field. The output is still in the original order. 0 never sorts them (integer, default 0).
+ *   * `integrator` - How to move the particles through each time step. `euler` is the original update; `leapfrog` (velocity Verlet) and `forest_ruth` are symplectic, so the energy error stays bounded and the time step can be bigger. Leapfrog looks the field up once per step, like Euler, and Forest-Ruth three times. With either, the last kick of each step is applied at the start of the next, so the velocities recorded along the trajectories, and when a particle collides, ionises or reaches the end, include it using the last field looked up; at the end of the run it's applied with a fresh lookup. Forest-Ruth looks the field up a little beyond each step's ends, so a `field_window` margin should cover more than a step's movement (string, default euler).
+ *   * `substep_gradient` - Split up the time step of any particle where the gradient of the field's magnitude is stronger than this (V/m^2), into as many pieces as the gradient is multiples of it (at most `max_substeps`), each moved with the integrator and its own field lookups. 0 never splits them (float, default 0).
+ *   * `max_substeps` - The most pieces that `substep_gradient` splits a time step into (integer, default 8).
  * * `particles`
  *   * `n_particles` - Number of particle to generate for the simulation (integer).
  *   * `position_dist` - How to distribute the particles in space. Can be one of the following: (string)
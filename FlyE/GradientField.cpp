@@ -0,0 +1,133 @@
+#include "GradientField.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PhysicalConstants.h"
+
+GradientField::GradientField(int x, int y, int z)
+    : x_(x),
+      y_(y),
+      z_(z),
+      magnitudes_(static_cast<size_t>(x) * y * z, 0.0),
+      staleMagnitudes_(z, true),
+      staleGradients_(z, true) {
+  for (auto &gradient : gradients_) {
+    gradient.assign(magnitudes_.size(), 0.0);
+  }
+}
+
+GridBox GradientField::all() const {
+  return GridBox(0, 0, 0, x_ - 1, y_ - 1, z_ - 1);
+}
+
+void GradientField::invalidate(const GridBox &changed) {
+  if (changed.empty()) return;
+
+  std::fill(staleMagnitudes_.begin() + std::max(changed.z0, 0), staleMagnitudes_.begin() + std::min(changed.z1 + 1, z_),
+            true);
+  std::fill(staleGradients_.begin() + std::max(changed.z0 - 1, 0), staleGradients_.begin() + std::min(changed.z1 + 2, z_),
+            true);
+}
+
+void GradientField::refresh(const VectorField &field, int zLow, int zHigh) {
+  zLow = std::max(zLow, 0);
+  zHigh = std::min(zHigh, z_ - 1);
+
+  // The stale gradients in the slab, and the magnitudes either side of them
+  int gradientLow = zLow, gradientHigh = zHigh;
+  while (gradientLow <= gradientHigh && !staleGradients_[gradientLow]) ++gradientLow;
+  while (gradientHigh >= gradientLow && !staleGradients_[gradientHigh]) --gradientHigh;
+  if (gradientLow > gradientHigh) return;
+
+  int magnitudeLow = std::max(gradientLow - 1, 0), magnitudeHigh = std::min(gradientHigh + 1, z_ - 1);
+  while (magnitudeLow <= magnitudeHigh && !staleMagnitudes_[magnitudeLow]) ++magnitudeLow;
+  while (magnitudeHigh >= magnitudeLow && !staleMagnitudes_[magnitudeHigh]) --magnitudeHigh;
+
+  if (magnitudeLow <= magnitudeHigh) {
+    sweepMagnitudes(field, magnitudeLow, magnitudeHigh);
+    std::fill(staleMagnitudes_.begin() + magnitudeLow, staleMagnitudes_.begin() + magnitudeHigh + 1, false);
+  }
+
+  sweepGradients(gradientLow, gradientHigh);
+  std::fill(staleGradients_.begin() + gradientLow, staleGradients_.begin() + gradientHigh + 1, false);
+}
+
+void GradientField::sweepMagnitudes(const VectorField &field, int zLow, int zHigh) {
+  const float *components = reinterpret_cast<const float*>(field.data());
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int x = 0; x < x_; ++x) {
+    for (int y = 0; y < y_; ++y) {
+      const float *row = components + 3 * index(x, y, 0);
+      float *magnitude = &magnitudes_[index(x, y, 0)];
+
+      for (int z = zLow; z <= zHigh; ++z) {
+        magnitude[z] = std::sqrt(row[3 * z] * row[3 * z] + row[3 * z + 1] * row[3 * z + 1] + row[3 * z + 2] * row[3 * z + 2]);
+      }
+    }
+  }
+}
+
+void GradientField::sweepGradients(int zLow, int zHigh) {
+  const float scale = 0.5 * Physics::MM_M_FACTOR;
+  const std::vector<float> zeros(z_, 0.0);  // The magnitudes just outside the grid
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int x = 0; x < x_; ++x) {
+    for (int y = 0; y < y_; ++y) {
+      const float *centre = &magnitudes_[index(x, y, 0)];
+      const float *left = (x > 0) ? &magnitudes_[index(x - 1, y, 0)] : zeros.data();
+      const float *right = (x < x_ - 1) ? &magnitudes_[index(x + 1, y, 0)] : zeros.data();
+      const float *below = (y > 0) ? &magnitudes_[index(x, y - 1, 0)] : zeros.data();
+      const float *above = (y < y_ - 1) ? &magnitudes_[index(x, y + 1, 0)] : zeros.data();
+      float *gradientX = &gradients_[0][index(x, y, 0)];
+      float *gradientY = &gradients_[1][index(x, y, 0)];
+      float *gradientZ = &gradients_[2][index(x, y, 0)];
+
+      for (int z = zLow; z <= zHigh; ++z) {
+        gradientX[z] = scale * (right[z] - left[z]);
+        gradientY[z] = scale * (above[z] - below[z]);
+      }
+
+      // Only the ends of the row need to look outside it
+      int innerLow = std::max(zLow, 1), innerHigh = std::min(zHigh, z_ - 2);
+      for (int z = innerLow; z <= innerHigh; ++z) {
+        gradientZ[z] = scale * (centre[z + 1] - centre[z - 1]);
+      }
+      if (zLow == 0) gradientZ[0] = scale * ((z_ > 1) ? centre[1] : 0.0);
+      if (zHigh == z_ - 1 && z_ > 1) gradientZ[z_ - 1] = -scale * centre[z_ - 2];
+    }
+  }
+}
+
+void GradientField::sample(float x, float y, float z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+  // The cell that the point is in, and how far across it the point is
+  int cell[3];
+  float weight[3];
+  const float position[3] = { x, y, z };
+  const int size[3] = { x_, y_, z_ };
+
+  for (int d = 0; d < 3; ++d) {
+    float clamped = std::min(std::max(position[d], 0.0f), static_cast<float>(size[d] - 1));
+    cell[d] = std::min(static_cast<int>(clamped), size[d] - 2);
+    weight[d] = clamped - cell[d];
+  }
+
+  float values[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+  for (int corner = 0; corner < 8; ++corner) {
+    int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+    float w = ((dx) ? weight[0] : 1 - weight[0]) * ((dy) ? weight[1] : 1 - weight[1])
+        * ((dz) ? weight[2] : 1 - weight[2]);
+    size_t i = index(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+
+    values[0] += w * magnitudes_[i];
+    values[1] += w * gradients_[0][i];
+    values[2] += w * gradients_[1][i];
+    values[3] += w * gradients_[2][i];
+  }
+
+  magnitude = values[0];
+  gradient = blitz::TinyVector<float, 3>(values[1], values[2], values[3]);
+}
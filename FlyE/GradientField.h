@@ -0,0 +1,113 @@
+/**@file GradientField.h
+ * @brief This file contains the GradientField class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <vector>
+
+#include "GridBox.h"
+#include "VectorField.h"
+
+/** @brief The magnitude of a field and its gradient at every grid point
+ *
+ * The gradient at each point is the same central difference of magnitudes as SmartField::gradientXat() etc, so nodeAt()
+ * gives exactly what SmartField does. Between points, sample() interpolates the magnitude and gradient trilinearly from
+ * the eight points around.
+ *
+ * When the field changes, the z-planes that it changed in are marked as stale (see invalidate()), and refresh() recomputes
+ * them in one parallel sweep, but only within the slab of z that's asked for: the rest are left until they're needed.
+ * The values are stored as separate arrays (each with z varying fastest) so that the sweep vectorises.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class GradientField {
+ protected:
+  ///@{ @brief Dimensions of the grid
+  int x_, y_, z_;  ///@}
+  std::vector<float> magnitudes_; //!< The magnitude at each point
+  std::vector<float> gradients_[3]; //!< The gradient in x, y and z at each point
+  std::vector<char> staleMagnitudes_; //!< Whether each z-plane's magnitudes need recomputing
+  std::vector<char> staleGradients_; //!< Whether each z-plane's gradients need recomputing
+
+  /** @brief The index of a point in the arrays */
+  inline size_t index(int x, int y, int z) const {
+    return (static_cast<size_t>(x) * y_ + y) * z_ + z;
+  }
+
+  /** @brief Recomputes the magnitudes in a slab
+   *
+   * @param field The field (contiguous, the same size as the grid)
+   * @param zLow The first z-plane of the slab
+   * @param zHigh The last z-plane of the slab
+   */
+  void sweepMagnitudes(const VectorField &field, int zLow, int zHigh);
+
+  /** @brief Recomputes the gradients in a slab, from the magnitudes
+   *
+   * @param zLow The first z-plane of the slab
+   * @param zHigh The last z-plane of the slab
+   */
+  void sweepGradients(int zLow, int zHigh);
+
+ public:
+  /** @brief Makes a field for a grid, with everything stale
+   *
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   */
+  GradientField(int x, int y, int z);
+
+  /** @brief A box of the whole grid */
+  GridBox all() const;
+
+  /** @brief Marks where the field has changed as stale
+   *
+   * The gradients are stale one plane further out than the magnitudes, since they depend on the planes either side.
+   *
+   * @param changed Where the field has changed
+   */
+  void invalidate(const GridBox &changed);
+
+  /** @brief Recomputes everything stale in a slab of z-planes
+   *
+   * @param field The field (contiguous, the same size as the grid)
+   * @param zLow The first z-plane of the slab (clamped to the grid)
+   * @param zHigh The last z-plane of the slab (clamped to the grid)
+   */
+  void refresh(const VectorField &field, int zLow, int zHigh);
+
+  /** @brief The magnitude and its gradient at a grid point, which must have been refreshed
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param[out] magnitude The magnitude of the field at the point (0 outside the grid)
+   * @param[out] gradient The gradient of the magnitude at the point (0 outside the grid)
+   */
+  inline void nodeAt(int x, int y, int z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+    if (x < 0 || y < 0 || z < 0 || x >= x_ || y >= y_ || z >= z_) {
+      magnitude = 0.0;
+      gradient = 0.0;
+      return;
+    }
+
+    size_t i = index(x, y, z);
+    magnitude = magnitudes_[i];
+    gradient = blitz::TinyVector<float, 3>(gradients_[0][i], gradients_[1][i], gradients_[2][i]);
+  }
+
+  /** @brief Interpolates the magnitude and its gradient at a point, whose cell must have been refreshed
+   *
+   * Points outside the grid take the values at the nearest edge.
+   *
+   * @param x x-coordinate of the point (grid spacings)
+   * @param y y-coordinate of the point (grid spacings)
+   * @param z z-coordinate of the point (grid spacings)
+   * @param[out] magnitude The magnitude of the field at the point
+   * @param[out] gradient The gradient of the magnitude at the point
+   */
+  void sample(float x, float y, float z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const;
+};
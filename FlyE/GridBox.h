@@ -0,0 +1,104 @@
+/**@file GridBox.h
+ * @brief This file contains the GridBox struct
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+/** @brief An axis-aligned box of grid points, with inclusive bounds
+ *
+ * Default constructed boxes are empty, and grow to fit points with expand().
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+struct GridBox {
+  ///@{ @brief The lowest point in the box
+  int x0 = 0, y0 = 0, z0 = 0;  ///@}
+  ///@{ @brief The highest point in the box
+  int x1 = -1, y1 = -1, z1 = -1;  ///@}
+
+  /** @brief Blank constructor, makes an empty box */
+  GridBox() {
+  }
+
+  /** @brief Constructs a box from its (inclusive) bounds */
+  GridBox(int lowX, int lowY, int lowZ, int highX, int highY, int highZ)
+      : x0(lowX), y0(lowY), z0(lowZ), x1(highX), y1(highY), z1(highZ) {
+  }
+
+  /** @brief Whether the box contains no points */
+  inline bool empty() const {
+    return x1 < x0 || y1 < y0 || z1 < z0;
+  }
+
+  /** @brief Whether a point is inside the box
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @return true if the point is inside the box
+   */
+  inline bool contains(int x, int y, int z) const {
+    return x >= x0 && x <= x1 && y >= y0 && y <= y1 && z >= z0 && z <= z1;
+  }
+
+  /** @brief The number of points in the box */
+  inline size_t nPoints() const {
+    return (empty()) ? 0 : static_cast<size_t>(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+  }
+
+  /** @brief Whether another box is entirely inside this one (an empty box is inside any box)
+   *
+   * @param other The box to check
+   * @return true if every point of other is inside this box
+   */
+  inline bool contains(const GridBox &other) const {
+    return other.empty()
+        || (other.x0 >= x0 && other.x1 <= x1 && other.y0 >= y0 && other.y1 <= y1 && other.z0 >= z0 && other.z1 <= z1);
+  }
+
+  /** @brief The box with a margin added on every side, clipped to another box
+   *
+   * @param margin The number of points to add on each side
+   * @param limits The box to clip to (usually the whole grid)
+   * @return The grown box, which is empty if this box is
+   */
+  inline GridBox grown(int margin, const GridBox &limits) const {
+    if (empty()) return GridBox();
+
+    return GridBox(std::max(x0 - margin, limits.x0), std::max(y0 - margin, limits.y0), std::max(z0 - margin, limits.z0),
+                   std::min(x1 + margin, limits.x1), std::min(y1 + margin, limits.y1), std::min(z1 + margin, limits.z1));
+  }
+
+  /** @brief Grows the box (if necessary) to include a point
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   */
+  inline void expand(int x, int y, int z) {
+    expand(GridBox(x, y, z, x, y, z));
+  }
+
+  /** @brief Grows the box (if necessary) to include another box
+   *
+   * @param other The box to include
+   */
+  inline void expand(const GridBox &other) {
+    if (other.empty()) return;
+    if (empty()) {
+      *this = other;
+      return;
+    }
+
+    x0 = std::min(x0, other.x0);
+    y0 = std::min(y0, other.y0);
+    z0 = std::min(z0, other.z0);
+    x1 = std::max(x1, other.x1);
+    y1 = std::max(y1, other.y1);
+    z1 = std::max(z1, other.z1);
+  }
+};
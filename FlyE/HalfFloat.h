@@ -0,0 +1,105 @@
+/** @file HalfFloat.h
+ * @brief Conversions between 32-bit floats and IEEE 754 half precision (fp16) floats
+ *
+ * Uses the F16C instructions when they're available (eg with -march=native on anything since Ivy Bridge), and falls back to
+ * bit manipulation otherwise.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace HalfFloat {
+
+constexpr float MAX = 65504.0; //!< The largest finite half precision float
+
+/** @brief Converts a float to half precision, rounding to nearest even
+ *
+ * Values too large for half precision are clamped to +/-MAX rather than becoming infinite.
+ *
+ * @param value The float to convert
+ * @return The bits of the half precision float
+ */
+inline uint16_t fromFloat(float value) {
+  if (value > MAX) value = MAX;
+  if (value < -MAX) value = -MAX;
+
+#ifdef __F16C__
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) {  // Inf or NaN
+    return sign | 0x7c00 | ((mantissa) ? 0x200 : 0);
+  }
+
+  if (exponent <= 0) {  // Subnormal (or zero) in half precision
+    if (exponent < -10) return sign;
+
+    mantissa |= 0x800000;  // Implicit leading bit
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+
+    if (remainder > halfway || (remainder == halfway && (half & 1))) ++half;
+    return sign | half;
+  }
+
+  uint32_t half = (exponent << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1fff;
+
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) ++half;  // May carry into the exponent, which is fine
+  return sign | half;
+#endif
+}
+
+/** @brief Converts a half precision float to a float
+ *
+ * @param half The bits of the half precision float
+ * @return The float it represents
+ */
+inline float toFloat(uint16_t half) {
+#ifdef __F16C__
+  return _cvtsh_ss(half);
+#else
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  int32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {  // Subnormal: normalise it
+      exponent = 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | ((exponent + 127 - 15) << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else if (exponent == 0x1f) {  // Inf or NaN
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+#endif
+}
+
+}
@@ -0,0 +1,165 @@
+#include "ImportPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <numeric>
+#include <omp.h>
+#include <thread>
+#include <unistd.h>
+
+#include "DatParser.h"
+#include "Electrode.h"
+#include "PhysicalConstants.h"
+#include "SubConfig.h"
+
+ImportPipeline::ImportPipeline(std::shared_ptr<AcceleratorConfig> config,
+                               std::vector<std::shared_ptr<Electrode> > &electrodes)
+    : config_(config),
+      electrodes_(electrodes),
+      nTasks_(config->nElectrodes() * config->x() * Physics::N_DIMENSIONS),
+      nParsers_(std::max(omp_get_max_threads(), 1)),
+      queues_(nParsers_),
+      bytesParsed_(0),
+      nFailed_(0),
+      nStolen_(0),
+      parserBusy_(nParsers_, 0.0),
+      progressBar_(nTasks_) {
+}
+
+std::string ImportPipeline::taskPath(int task) const {
+  int e = task / (config_->x() * Physics::N_DIMENSIONS);
+  int x = (task / Physics::N_DIMENSIONS) % config_->x();
+  int d = task % Physics::N_DIMENSIONS;
+
+  return config_->datPath(e + 1, x, d);
+}
+
+bool ImportPipeline::run() {
+  std::cout << "Importing " << config_->nElectrodes() << " electrodes (" << nTasks_ << " files, "
+            << nParsers_ << " parsers)..." << std::endl;
+
+  progressBar_.start();
+  auto startTime = std::chrono::steady_clock::now();
+
+  std::thread reader(&ImportPipeline::read, this);
+  std::vector<std::thread> parsers;
+  for (int parser = 0; parser < nParsers_; ++parser) {
+    parsers.emplace_back(&ImportPipeline::parse, this, parser);
+  }
+
+  reader.join();
+  for (auto &parser : parsers) {
+    parser.join();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+  double parsersBusy = std::accumulate(parserBusy_.begin(), parserBusy_.end(), 0.0);
+
+  std::cout << std::endl;
+  std::cout << "Parsed " << bytesParsed_ / 1e6 << " MB in " << elapsed.count() << " s ("
+            << bytesParsed_ / 1e6 / elapsed.count() << " MB/s)" << std::endl;
+  std::cout << "Reader busy " << 100 * readerBusy_ / elapsed.count() << "% of the time, parsers "
+            << 100 * parsersBusy / (nParsers_ * elapsed.count()) << "% (" << nStolen_ << " tasks stolen)" << std::endl;
+
+  return nFailed_ == 0;
+}
+
+void ImportPipeline::read() {
+  for (int task = 0; task < nTasks_; ++task) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      parsed_.wait(lock, [&] {return task - nParsed_ < READAHEAD_FILES;});
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    int fd = open(taskPath(task).c_str(), O_RDONLY);
+    if (fd >= 0) {  // A missing file is reported by the parser
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);  // Starts reading it in the background
+      close(fd);
+    }
+
+    readerBusy_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    TaskQueue &queue = queues_[task % nParsers_];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(task);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++nQueued_;
+    }
+    queued_.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    readerDone_ = true;
+  }
+  queued_.notify_all();
+}
+
+bool ImportPipeline::takeTask(int parser, int &task) {
+  for (int i = 0; i < nParsers_; ++i) {
+    TaskQueue &queue = queues_[(parser + i) % nParsers_];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty()) continue;
+
+    if (i == 0) {  // Our own queue: oldest first, since it was prefetched first
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+    } else {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      ++nStolen_;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void ImportPipeline::parse(int parser) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [&] {return nQueued_ > 0 || readerDone_;});
+
+      if (nQueued_ == 0) return;  // The reader's finished and there's nothing left
+      --nQueued_;  // Claim a task; it's in one of the queues
+    }
+
+    int task;
+    while (!takeTask(parser, task)) {  // Only if the queues changed while we looked; there's always one for us
+      std::this_thread::yield();
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    int e = task / (config_->x() * Physics::N_DIMENSIONS);
+    int x = (task / Physics::N_DIMENSIONS) % config_->x();
+    int d = task % Physics::N_DIMENSIONS;
+
+    size_t bytes = DatParser::parseFile(taskPath(task), reinterpret_cast<float*>(electrodes_[e]->data()),
+                                        x, d, config_->y(), config_->z());
+    bytesParsed_ += bytes;
+    if (bytes == 0) ++nFailed_;
+
+    parserBusy_[parser] += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    {
+      std::lock_guard<std::mutex> lock(barMutex_);
+      ++progressBar_;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++nParsed_;
+    }
+    parsed_.notify_one();
+  }
+}
@@ -0,0 +1,103 @@
+/**@file ImportPipeline.h
+ * @brief This file contains the ImportPipeline class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ezETAProgressBar.hpp"
+
+class AcceleratorConfig;
+class Electrode;
+
+/** @brief Imports every Electrode's .dat files, overlapping the disk reads with the parsing
+ *
+ * There's one task per .dat file: (electrode, layer, axis). A reader thread works through the tasks in order, asking the OS to
+ * read each file ahead (with posix_fadvise) and then queueing the task. It stays a fixed number of files ahead of the parsers,
+ * so the prefetched files are still in the page cache when they're parsed. The reader queues tasks round-robin onto one queue
+ * per parser thread. Each parser takes tasks from the front of its own queue and, when that's empty, steals from the back of
+ * the others'.
+ *
+ * The wall time, bytes read, and how busy the reader and the parsers were are reported at the end.
+ *
+ * @see DatParser
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class ImportPipeline {
+ protected:
+  /** @brief One parser thread's queue of tasks */
+  struct TaskQueue {
+    std::mutex mutex; //!< Guards tasks
+    std::deque<int> tasks; //!< Indices of the queued tasks
+  };
+
+  std::shared_ptr<AcceleratorConfig> config_; //!< The configuration of the geometry
+  std::vector<std::shared_ptr<Electrode> > &electrodes_; //!< The Electrodes to import into (already the right size)
+  int nTasks_; //!< The number of tasks (.dat files)
+  int nParsers_; //!< The number of parser threads
+
+  std::vector<TaskQueue> queues_; //!< A queue of tasks for each parser
+  std::mutex mutex_; //!< Guards the counters that the threads wait on
+  std::condition_variable queued_; //!< Signalled when a task is queued (or the reader finishes)
+  std::condition_variable parsed_; //!< Signalled when a task has been parsed
+  int nQueued_ = 0; //!< The number of tasks queued but not yet taken by a parser
+  int nParsed_ = 0; //!< The number of tasks parsed
+  bool readerDone_ = false; //!< Whether the reader has queued every task
+
+  std::atomic<size_t> bytesParsed_; //!< The total size of the parsed files (bytes)
+  std::atomic<int> nFailed_; //!< The number of files that couldn't be read
+  std::atomic<int> nStolen_; //!< The number of tasks that were stolen from another parser's queue
+  double readerBusy_ = 0.0; //!< The time the reader spent opening and prefetching files (s)
+  std::vector<double> parserBusy_; //!< The time each parser spent parsing (s)
+
+  std::mutex barMutex_; //!< Guards the progress bar
+  ez::ezETAProgressBar progressBar_; //!< Shows the progress of the import
+
+  /** @brief The reader stage: prefetches each file and queues its task */
+  void read();
+
+  /** @brief A parser stage: parses queued tasks until there are none left
+   *
+   * @param parser The index of this parser (and its queue)
+   */
+  void parse(int parser);
+
+  /** @brief Takes a task from a parser's own queue or, failing that, steals one from another queue
+   *
+   * @param parser The index of the parser
+   * @param[out] task The index of the task that was taken
+   * @return true if a task was taken
+   */
+  bool takeTask(int parser, int &task);
+
+  /** @brief The path of the .dat file for a task
+   *
+   * @param task The index of the task
+   * @return The path of the .dat file
+   */
+  std::string taskPath(int task) const;
+
+ public:
+  static constexpr int READAHEAD_FILES = 64; //!< How many files the reader can get ahead of the parsers
+
+  /** @brief Sets up a pipeline to import the .dat files of the given Electrodes
+   *
+   * @param config The configuration of the geometry
+   * @param electrodes The Electrodes to import into, which must already be the right size
+   */
+  ImportPipeline(std::shared_ptr<AcceleratorConfig> config, std::vector<std::shared_ptr<Electrode> > &electrodes);
+
+  /** @brief Imports every file and reports on how it went
+   *
+   * @return true if every file was read
+   */
+  bool run();
+};
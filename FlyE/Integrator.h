@@ -0,0 +1,94 @@
+/**@file Integrator.h
+ * @brief This file contains the Integrator struct
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+/** @brief How the Simulator moves a particle through a time step
+ *
+ * Euler is the update the Simulator has always used: the velocity is kicked by the acceleration, then the position moves
+ * by the new velocity plus half the acceleration times the time step squared. It's cheap but not symplectic, so the
+ * energy error grows with the time step.
+ *
+ * The others are symplectic splittings, written as alternating kicks (v += a k h) and drifts (r += v d h):
+ * - Leapfrog (velocity Verlet): kick 1/2, drift 1, kick 1/2. Second order.
+ * - Forest-Ruth: kick θ/2, drift θ, kick (1-θ)/2, drift 1-2θ, kick (1-θ)/2, drift θ, kick θ/2, with θ = 1/(2-2^(1/3)).
+ *   Fourth order.
+ *
+ * The last kick of a step is at the same position as the first kick of the next, so the Simulator defers it (see
+ * ParticleStore::pendingKick()) and applies both with the acceleration it looks up at the start of the next step. So
+ * leapfrog costs one field lookup per step, like Euler, and Forest-Ruth three.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+struct Integrator {
+  /** @brief The available integrators */
+  enum Method {
+    EULER = 0, //!< The original (non-symplectic) update
+    LEAPFROG, //!< Velocity Verlet
+    FOREST_RUTH //!< Forest-Ruth
+  };
+
+  static constexpr int MAX_DRIFTS = 3; //!< The most drifts in a step of any integrator
+
+  Method method; //!< Which integrator this is
+  int nDrifts; //!< The number of drifts in a step (there's one more kick)
+  float kicks[MAX_DRIFTS + 1]; //!< The fraction of the step that each kick lasts
+  float drifts[MAX_DRIFTS]; //!< The fraction of the step that each drift lasts
+
+  /** @brief The integrator with a name
+   *
+   * @param name "euler", "leapfrog" or "forest_ruth"
+   * @return The integrator (Euler if the name isn't recognised)
+   */
+  static Integrator named(const std::string &name) {
+    if (name == "leapfrog") return make(LEAPFROG);
+    if (name == "forest_ruth") return make(FOREST_RUTH);
+    return make(EULER);
+  }
+
+  /** @brief The integrator using a method
+   *
+   * @param method The method
+   * @return The integrator, with its coefficients
+   */
+  static Integrator make(Method method) {
+    const float theta = 1.0 / (2.0 - std::cbrt(2.0));
+
+    switch (method) {
+      case LEAPFROG:
+        return {LEAPFROG, 1, {0.5, 0.5}, {1.0}};
+      case FOREST_RUTH:
+        return {FOREST_RUTH, 3, {theta / 2, (1 - theta) / 2, (1 - theta) / 2, theta / 2},
+                {theta, 1 - 2 * theta, theta}};
+      default:
+        return {EULER, 1, {1.0, 0.0}, {1.0}};
+    }
+  }
+
+  /** @brief How far a step's drifts take a particle from where it started, as fractions of the step
+   *
+   * @param[out] lowest The furthest back (0 or less; Forest-Ruth's second drift goes backwards)
+   * @param[out] highest The furthest forward (1 or more; Forest-Ruth's first drift overshoots)
+   */
+  inline void reach(float &lowest, float &highest) const {
+    float at = 0.0;
+    lowest = highest = 0.0;
+
+    for (int k = 0; k < nDrifts; ++k) {
+      at += drifts[k];
+      lowest = std::min(lowest, at);
+      highest = std::max(highest, at);
+    }
+  }
+
+  /** @brief Whether this is a symplectic splitting (anything but Euler) */
+  inline bool symplectic() const {
+    return method != EULER;
+  }
+};
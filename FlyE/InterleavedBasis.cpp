@@ -0,0 +1,152 @@
+#include "InterleavedBasis.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "Electrode.h"
+#include "FieldWindow.h"
+#include "PhysicalConstants.h"
+
+namespace {
+
+constexpr size_t CACHE_LINE = 64;
+
+// The three dot products of (padded) voltages with a point's block
+inline void dot3(const float *block, const float *voltages, int stride, float *field) {
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d, block += stride) {
+#if defined(__AVX512F__)
+    __m512 sum = _mm512_setzero_ps();
+    for (int e = 0; e < stride; e += 16) {
+      sum = _mm512_fmadd_ps(_mm512_loadu_ps(voltages + e), _mm512_load_ps(block + e), sum);
+    }
+    field[d] = _mm512_reduce_add_ps(sum);
+#elif defined(__AVX__)
+    __m256 sum = _mm256_setzero_ps();
+    for (int e = 0; e < stride; e += 8) {
+#ifdef __FMA__
+      sum = _mm256_fmadd_ps(_mm256_loadu_ps(voltages + e), _mm256_load_ps(block + e), sum);
+#else
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(voltages + e), _mm256_load_ps(block + e)));
+#endif
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_hadd_ps(half, half);
+    half = _mm_hadd_ps(half, half);
+    field[d] = _mm_cvtss_f32(half);
+#else
+    float sum = 0;
+    for (int e = 0; e < stride; ++e) {
+      sum += voltages[e] * block[e];
+    }
+    field[d] = sum;
+#endif
+  }
+}
+
+}
+
+constexpr int InterleavedBasis::SIMD_WIDTH;
+
+InterleavedBasis::InterleavedBasis(const std::vector<std::shared_ptr<Electrode> > &electrodes, int x, int y, int z)
+    : x_(x),
+      y_(y),
+      z_(z),
+      nElectrodes_(electrodes.size()),
+      stride_((nElectrodes_ + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH),
+      fields_(nullptr, std::free) {
+  static_assert(SIMD_WIDTH * sizeof(float) <= CACHE_LINE, "Blocks wouldn't be aligned for the SIMD loads");
+
+  const size_t blockSize = Physics::N_DIMENSIONS * stride_;
+  void *memory = nullptr;
+  if (posix_memalign(&memory, CACHE_LINE, size()) != 0) {
+    std::cout << "Error allocating the interleaved basis (" << size() / 1e6 << " MB)" << std::endl;
+    throw std::bad_alloc();
+  }
+  fields_.reset(static_cast<float*>(memory));
+
+#pragma omp parallel for collapse(2)
+  for (int i = 0; i < x_; ++i) {
+    for (int j = 0; j < y_; ++j) {
+      for (int k = 0; k < z_; ++k) {
+        float *block = fields_.get() + ((static_cast<size_t>(i) * y_ + j) * z_ + k) * blockSize;
+        std::fill(block, block + blockSize, 0.0);
+
+        for (int e = 0; e < nElectrodes_; ++e) {
+          if (!electrodes[e]->support().contains(i, j, k)) continue;
+
+          blitz::TinyVector<float, 3> field = electrodes[e]->fieldAt(i, j, k);
+          for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+            block[d * stride_ + e] = field[d];
+          }
+        }
+      }
+    }
+  }
+}
+
+std::vector<float> InterleavedBasis::pad(const std::vector<float> &voltages) const {
+  std::vector<float> padded(stride_, 0.0);
+  std::copy(voltages.begin(), voltages.begin() + nElectrodes_, padded.begin());
+
+  return padded;
+}
+
+blitz::TinyVector<float, 3> InterleavedBasis::fieldAt(const std::vector<float> &voltages, int x, int y, int z) const {
+  std::vector<float> padded = pad(voltages);
+  const float *block = fields_.get() + ((static_cast<size_t>(x) * y_ + y) * z_ + z) * Physics::N_DIMENSIONS * stride_;
+
+  blitz::TinyVector<float, 3> field;
+  dot3(block, padded.data(), stride_, field.data());
+
+  return field;
+}
+
+void InterleavedBasis::superpose(const std::vector<float> &voltages, VectorField &field) const {
+  superpose(voltages, field, GridBox(0, 0, 0, x_ - 1, y_ - 1, z_ - 1));
+}
+
+void InterleavedBasis::superpose(const std::vector<float> &voltages, VectorField &field, const GridBox &box) const {
+  if (box.empty()) return;
+
+  std::vector<float> padded = pad(voltages);
+  const size_t blockSize = Physics::N_DIMENSIONS * stride_;
+
+#pragma omp parallel for collapse(2)
+  for (int i = box.x0; i <= box.x1; ++i) {
+    for (int j = box.y0; j <= box.y1; ++j) {
+      const float *block = fields_.get() + ((static_cast<size_t>(i) * y_ + j) * z_ + box.z0) * blockSize;
+
+      for (int k = box.z0; k <= box.z1; ++k, block += blockSize) {
+        dot3(block, padded.data(), stride_, field(i, j, k).data());
+      }
+    }
+  }
+}
+
+void InterleavedBasis::superpose(const std::vector<float> &voltages, FieldWindow &window) const {
+  std::vector<float> padded = pad(voltages);
+  const size_t blockSize = Physics::N_DIMENSIONS * stride_;
+  const GridBox &tile = window.tile();
+
+#pragma omp parallel for collapse(2)
+  for (int i = tile.x0; i <= tile.x1; ++i) {
+    for (int j = tile.y0; j <= tile.y1; ++j) {
+      const float *block = fields_.get() + ((static_cast<size_t>(i) * y_ + j) * z_ + tile.z0) * blockSize;
+      float *row = window.fieldAt(i, j, tile.z0);
+
+      for (int k = tile.z0; k <= tile.z1; ++k, block += blockSize, row += 3) {
+        dot3(block, padded.data(), stride_, row);
+      }
+    }
+  }
+}
+
+size_t InterleavedBasis::size() const {
+  return sizeof(float) * Physics::N_DIMENSIONS * stride_ * static_cast<size_t>(x_) * y_ * z_;
+}
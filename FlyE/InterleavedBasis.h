@@ -0,0 +1,100 @@
+/**@file InterleavedBasis.h
+ * @brief This file contains the InterleavedBasis class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "GridBox.h"
+#include "VectorField.h"
+
+class Electrode;
+class FieldWindow;
+
+/** @brief Every Electrode's field, stored with the electrodes varying fastest
+ *
+ * Each point has a block of every electrode's x components, then every y component, then every z component, each padded to
+ * a whole number of SIMD vectors (and aligned to a cache line). The field at a point is then three dot products of the
+ * voltages with the block, which are done with AVX-512 or AVX2 FMA instructions when they're available.
+ *
+ * This is a copy of the basis (in 32-bit floats, whatever the Electrodes' storage), so it costs about as much memory as
+ * the Electrodes themselves. It's copied from the Electrodes after they're packed, so it holds the same decoded values
+ * that they add on.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class InterleavedBasis {
+ protected:
+  ///@{ @brief Dimensions of the grid
+  int x_, y_, z_;  ///@}
+  int nElectrodes_; //!< The number of electrodes
+  int stride_; //!< The number of floats in each component of a point's block (nElectrodes_, padded to the SIMD width)
+  std::unique_ptr<float, void (*)(void*)> fields_; //!< The blocks of every point (z varying fastest)
+
+  /** @brief Pads voltages to the SIMD width
+   *
+   * @param voltages A voltage for each electrode
+   * @return The voltages, followed by zeros
+   */
+  std::vector<float> pad(const std::vector<float> &voltages) const;
+
+ public:
+#if defined(__AVX512F__)
+  static constexpr int SIMD_WIDTH = 16; //!< The number of floats in a SIMD vector
+#elif defined(__AVX__)
+  static constexpr int SIMD_WIDTH = 8; //!< The number of floats in a SIMD vector
+#else
+  static constexpr int SIMD_WIDTH = 4; //!< The number of floats in a SIMD vector
+#endif
+
+  /** @brief Interleaves the fields of a set of Electrodes
+   *
+   * @param electrodes The Electrodes (all loaded)
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   */
+  InterleavedBasis(const std::vector< std::shared_ptr<Electrode> > &electrodes, int x, int y, int z);
+
+  /** @brief The superposed field at a point
+   *
+   * @param voltages A voltage for each electrode
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @return The field at (x, y, z)
+   */
+  blitz::TinyVector<float, 3> fieldAt(const std::vector<float> &voltages, int x, int y, int z) const;
+
+  /** @brief Superposes the whole field
+   *
+   * @param voltages A voltage for each electrode
+   * @param[out] field The field to overwrite, the same size as the grid
+   */
+  void superpose(const std::vector<float> &voltages, VectorField &field) const;
+
+  /** @brief Superposes part of the field
+   *
+   * The points are summed exactly as superpose() sums them, so this can bring a box up to date without the field drifting
+   * from a full superposition.
+   *
+   * @param voltages A voltage for each electrode
+   * @param[out] field The field to overwrite inside the box, the same size as the grid
+   * @param box The points to superpose
+   */
+  void superpose(const std::vector<float> &voltages, VectorField &field, const GridBox &box) const;
+
+  /** @brief Superposes the field in a FieldWindow's tile
+   *
+   * @param voltages A voltage for each electrode
+   * @param[out] window The window to fill, which has just been placed
+   */
+  void superpose(const std::vector<float> &voltages, FieldWindow &window) const;
+
+  /** @brief The memory used (bytes) */
+  size_t size() const;
+};
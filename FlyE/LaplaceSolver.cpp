@@ -0,0 +1,229 @@
+#include "LaplaceSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PotentialArray.h"
+
+constexpr double LaplaceSolver::ELECTRODE_VOLTAGE;
+
+LaplaceSolver::LaplaceSolver(const std::vector<int> &labels, int nx, int ny, int nz, double tolerance, int maxCycles)
+    : labels_(labels),
+      tolerance_(tolerance),
+      maxCycles_(maxCycles) {
+  Level finest;
+  finest.nx = nx;
+  finest.ny = ny;
+  finest.nz = nz;
+  finest.h2 = 1;
+  finest.fixed.resize(labels_.size());
+
+  for (int z = 0; z < nz; ++z) {
+    for (int y = 0; y < ny; ++y) {
+      for (int x = 0; x < nx; ++x) {
+        bool edge = x == 0 || y == 0 || z == 0 || x == nx - 1 || y == ny - 1 || z == nz - 1;
+        finest.fixed[finest.index(x, y, z)] = edge || labels_[finest.index(x, y, z)] != -1;
+      }
+    }
+  }
+
+  levels_.push_back(finest);
+
+  // Each coarse point sits on every other fine point. It's fixed if any fine point around it is, so thin electrodes don't
+  // disappear from the coarse grids (which stops the cycles converging)
+  while (coarseSize(std::min( { levels_.back().nx, levels_.back().ny, levels_.back().nz })) >= MIN_SIZE) {
+    const Level &fine = levels_.back();
+    Level coarse;
+    coarse.nx = coarseSize(fine.nx);
+    coarse.ny = coarseSize(fine.ny);
+    coarse.nz = coarseSize(fine.nz);
+    coarse.h2 = 4 * fine.h2;
+    coarse.fixed.resize(static_cast<size_t>(coarse.nx) * coarse.ny * coarse.nz);
+
+    for (int z = 0; z < coarse.nz; ++z) {
+      for (int y = 0; y < coarse.ny; ++y) {
+        for (int x = 0; x < coarse.nx; ++x) {
+          bool fixed = x == 0 || y == 0 || z == 0 || x == coarse.nx - 1 || y == coarse.ny - 1 || z == coarse.nz - 1;
+
+          for (int dz = -1; dz <= 1 && !fixed; ++dz) {
+            for (int dy = -1; dy <= 1 && !fixed; ++dy) {
+              for (int dx = -1; dx <= 1 && !fixed; ++dx) {
+                fixed = fine.fixed[fine.index(2 * x + dx, 2 * y + dy, 2 * z + dz)];
+              }
+            }
+          }
+
+          coarse.fixed[coarse.index(x, y, z)] = fixed;
+        }
+      }
+    }
+
+    levels_.push_back(coarse);
+  }
+
+  for (auto &level : levels_) {
+    size_t nPoints = level.fixed.size();
+    level.u.assign(nPoints, 0.0);
+    level.f.assign(nPoints, 0.0);
+    level.r.assign(nPoints, 0.0);
+  }
+}
+
+int LaplaceSolver::coarseSize(int n) {
+  // With an odd n, the last coarse point sits on the fine edge. With an even n, the fine edge is one past the last point
+  // with a coarse point on it, so it gets a coarse point of its own (the fine point before it is next to the edge, so the
+  // coarse point on it is fixed, and nothing is interpolated from the short gap between them)
+  return n / 2 + 1;
+}
+
+void LaplaceSolver::smooth(Level &level, int nSweeps) {
+  const size_t rowStride = level.nx;
+  const size_t planeStride = rowStride * level.ny;
+
+  for (int sweep = 0; sweep < nSweeps; ++sweep) {
+    for (int colour = 0; colour < 2; ++colour) {
+#pragma omp parallel for collapse(2) schedule(static)
+      for (int z = 1; z < level.nz - 1; ++z) {
+        for (int y = 1; y < level.ny - 1; ++y) {
+          // Points of one colour only have neighbours of the other, so a row can be updated in any order
+          for (int x = 1 + ((1 + y + z + colour) & 1); x < level.nx - 1; x += 2) {
+            size_t i = level.index(x, y, z);
+            if (level.fixed[i]) continue;
+
+            double neighbours = level.u[i - 1] + level.u[i + 1] + level.u[i - rowStride] + level.u[i + rowStride]
+                + level.u[i - planeStride] + level.u[i + planeStride];
+            level.u[i] = (neighbours + level.h2 * level.f[i]) / 6;
+          }
+        }
+      }
+    }
+  }
+}
+
+double LaplaceSolver::residual(Level &level) {
+  const size_t rowStride = level.nx;
+  const size_t planeStride = rowStride * level.ny;
+  double maxResidual = 0;
+
+#pragma omp parallel for collapse(2) schedule(static) reduction(max:maxResidual)
+  for (int z = 0; z < level.nz; ++z) {
+    for (int y = 0; y < level.ny; ++y) {
+      for (int x = 0; x < level.nx; ++x) {
+        size_t i = level.index(x, y, z);
+        if (level.fixed[i]) {  // Includes the edges, so the neighbours below are always in the grid
+          level.r[i] = 0;
+          continue;
+        }
+
+        double neighbours = level.u[i - 1] + level.u[i + 1] + level.u[i - rowStride] + level.u[i + rowStride]
+            + level.u[i - planeStride] + level.u[i + planeStride];
+        level.r[i] = level.f[i] - (6 * level.u[i] - neighbours) / level.h2;
+        maxResidual = std::max(maxResidual, std::abs(level.r[i]));
+      }
+    }
+  }
+
+  return maxResidual * level.h2 / 6;
+}
+
+void LaplaceSolver::restrict(const Level &fine, Level &coarse) {
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int z = 0; z < coarse.nz; ++z) {
+    for (int y = 0; y < coarse.ny; ++y) {
+      for (int x = 0; x < coarse.nx; ++x) {
+        size_t i = coarse.index(x, y, z);
+        coarse.u[i] = 0;
+        coarse.f[i] = 0;
+        if (coarse.fixed[i]) continue;
+
+        double sum = 0;
+        for (int dz = -1; dz <= 1; ++dz) {
+          for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+              double weight = ((dx == 0) ? 1.0 : 0.5) * ((dy == 0) ? 1.0 : 0.5) * ((dz == 0) ? 1.0 : 0.5);
+              sum += weight * fine.r[fine.index(2 * x + dx, 2 * y + dy, 2 * z + dz)];
+            }
+          }
+        }
+
+        coarse.f[i] = sum / 8;
+      }
+    }
+  }
+}
+
+void LaplaceSolver::prolong(const Level &coarse, Level &fine) {
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int z = 1; z < fine.nz - 1; ++z) {
+    for (int y = 1; y < fine.ny - 1; ++y) {
+      int y0 = y / 2, y1 = (y + 1) / 2;
+      int z0 = z / 2, z1 = (z + 1) / 2;
+
+      for (int x = 1; x < fine.nx - 1; ++x) {
+        size_t i = fine.index(x, y, z);
+        if (fine.fixed[i]) continue;
+
+        // Even fine points sit on a coarse point; odd ones are halfway between two
+        int x0 = x / 2, x1 = (x + 1) / 2;
+        double correction = coarse.u[coarse.index(x0, y0, z0)] + coarse.u[coarse.index(x1, y0, z0)]
+            + coarse.u[coarse.index(x0, y1, z0)] + coarse.u[coarse.index(x1, y1, z0)]
+            + coarse.u[coarse.index(x0, y0, z1)] + coarse.u[coarse.index(x1, y0, z1)]
+            + coarse.u[coarse.index(x0, y1, z1)] + coarse.u[coarse.index(x1, y1, z1)];
+        fine.u[i] += correction / 8;
+      }
+    }
+  }
+}
+
+void LaplaceSolver::vCycle(int l) {
+  if (l == static_cast<int>(levels_.size()) - 1) {
+    smooth(levels_[l], COARSEST_SWEEPS);
+    return;
+  }
+
+  smooth(levels_[l], PRE_SWEEPS);
+  residual(levels_[l]);
+  restrict(levels_[l], levels_[l + 1]);
+  vCycle(l + 1);
+  prolong(levels_[l + 1], levels_[l]);
+  smooth(levels_[l], POST_SWEEPS);
+}
+
+std::vector<double> LaplaceSolver::solve(int electrode, int &nCycles) {
+  Level &finest = levels_[0];
+
+  for (size_t i = 0; i < finest.u.size(); ++i) {
+    finest.u[i] = (labels_[i] == electrode) ? ELECTRODE_VOLTAGE : 0.0;
+    finest.f[i] = 0;
+  }
+
+  for (nCycles = 1; nCycles <= maxCycles_; ++nCycles) {
+    vCycle(0);
+    if (residual(finest) < tolerance_ * ELECTRODE_VOLTAGE) break;
+  }
+  nCycles = std::min(nCycles, maxCycles_);
+
+  std::vector<double> values(finest.u);
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (labels_[i] != -1) values[i] += 2 * ELECTRODE_VOLTAGE;  // Marks electrode points like SIMION does
+  }
+
+  return values;
+}
+
+std::vector<int> LaplaceSolver::labelsFromGeometry(const PotentialArray &geometry) {
+  std::vector<int> labels(static_cast<size_t>(geometry.nx()) * geometry.ny() * geometry.nz(), -1);
+
+  for (int z = 0; z < geometry.nz(); ++z) {
+    for (int y = 0; y < geometry.ny(); ++y) {
+      for (int x = 0; x < geometry.nx(); ++x) {
+        if (geometry.isElectrode(x, y, z)) {
+          labels[(static_cast<size_t>(z) * geometry.ny() + y) * geometry.nx() + x] = std::lround(
+              geometry.potential(x, y, z));
+        }
+      }
+    }
+  }
+
+  return labels;
+}
@@ -0,0 +1,126 @@
+/**@file LaplaceSolver.h
+ * @brief This file contains the LaplaceSolver class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class PotentialArray;
+
+/** @brief A multigrid solver for the potential of each electrode in a geometry
+ *
+ * Replaces SIMION's refine step. The geometry is given as a label for every point of the potential array: -1 for free space,
+ * 0 for grounded electrode points, or the (SIMION) number of the electrode. solve() finds the potential with one electrode at
+ * ELECTRODE_VOLTAGE and every other electrode (and the edge of the array) at 0V, by V-cycles of red-black Gauss-Seidel on a
+ * hierarchy of grids, each half the size of the last. The result is encoded like a SIMION .paN file, so the field can be
+ * derived with PotentialArray::deriveField().
+ *
+ * @see PotentialArray
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class LaplaceSolver {
+ protected:
+  /** @brief One grid in the multigrid hierarchy (x varying fastest) */
+  struct Level {
+    ///@{ @brief Dimensions of the grid
+    int nx, ny, nz;  ///@}
+    double h2; //!< The square of the spacing between points (in finest grid spacings)
+    std::vector<double> u; //!< The potential (or, on coarse grids, the correction to it)
+    std::vector<double> f; //!< The right hand side (the restricted residual, on coarse grids)
+    std::vector<double> r; //!< The residual
+    std::vector<char> fixed; //!< Whether each point has a fixed value (electrodes and the edge of the grid)
+
+    /** @brief The index of a point in the grid's vectors */
+    inline size_t index(int x, int y, int z) const {
+      return (static_cast<size_t>(z) * ny + y) * nx + x;
+    }
+  };
+
+  std::vector<int> labels_; //!< The label of each point on the finest grid
+  std::vector<Level> levels_; //!< The grids, finest first
+  double tolerance_; //!< The largest update (as a fraction of ELECTRODE_VOLTAGE) at which the solution is converged
+  int maxCycles_; //!< The most V-cycles to run
+
+  /** @brief The size of the next grid down along one direction
+   *
+   * Coarse point i sits on fine point 2i, except the last, which always sits on the fine edge (n - 1), so the edges of
+   * every grid line up whether n is odd or even.
+   *
+   * @param n The size of the fine grid along the direction
+   * @return The size of the coarse grid
+   */
+  static int coarseSize(int n);
+
+  /** @brief Red-black Gauss-Seidel sweeps over the free points of a grid
+   *
+   * @param level The grid to smooth
+   * @param nSweeps The number of (red and black) sweeps
+   */
+  void smooth(Level &level, int nSweeps);
+
+  /** @brief Computes the residual of a grid
+   *
+   * @param level The grid
+   * @return The largest Gauss-Seidel update that the residual would give (V)
+   */
+  double residual(Level &level);
+
+  /** @brief Full-weighting restriction of a grid's residual to the right hand side of the next grid down
+   *
+   * @param fine The grid whose residual is restricted
+   * @param coarse The grid to restrict to
+   */
+  void restrict(const Level &fine, Level &coarse);
+
+  /** @brief Trilinear interpolation of a coarse grid's correction, added to the free points of the next grid up
+   *
+   * @param coarse The grid whose correction is interpolated
+   * @param fine The grid to correct
+   */
+  void prolong(const Level &coarse, Level &fine);
+
+  /** @brief Runs a V-cycle from a grid down
+   *
+   * @param l The index of the grid
+   */
+  void vCycle(int l);
+
+ public:
+  static constexpr double ELECTRODE_VOLTAGE = 10000; //!< Like SIMION's fast adjust arrays, so the fields scale the same way
+  static constexpr int PRE_SWEEPS = 2; //!< Sweeps before each coarse grid correction
+  static constexpr int POST_SWEEPS = 2; //!< Sweeps after each coarse grid correction
+  static constexpr int COARSEST_SWEEPS = 100; //!< Sweeps on the coarsest grid
+  static constexpr int MIN_SIZE = 5; //!< The smallest size of a grid in any direction
+
+  /** @brief Sets up the solver for a geometry
+   *
+   * @param labels The label of each point (x varying fastest): -1 for free space, 0 for ground, or an electrode number
+   * @param nx The size of the potential array along x
+   * @param ny The size of the potential array along y
+   * @param nz The size of the potential array along z
+   * @param tolerance The largest update (as a fraction of ELECTRODE_VOLTAGE) at which the solution is converged
+   * @param maxCycles The most V-cycles to run
+   */
+  LaplaceSolver(const std::vector<int> &labels, int nx, int ny, int nz, double tolerance, int maxCycles = 200);
+
+  /** @brief Solves for the potential of one electrode
+   *
+   * @param electrode The number of the electrode (its label) to put at ELECTRODE_VOLTAGE
+   * @param[out] nCycles The number of V-cycles it took
+   * @return nx * ny * nz potentials (x varying fastest), with electrode points marked by adding 2 * ELECTRODE_VOLTAGE
+   */
+  std::vector<double> solve(int electrode, int &nCycles);
+
+  /** @brief Labels the points of a SIMION geometry (.pa#) file
+   *
+   * In a .pa# file, each electrode point's potential is the number of its electrode (0 for ground).
+   *
+   * @param geometry The geometry file
+   * @return The label of each point of the array
+   */
+  static std::vector<int> labelsFromGeometry(const PotentialArray &geometry);
+};
@@ -0,0 +1,43 @@
+#include "MagnitudeCache.h"
+
+MagnitudeCache::MagnitudeCache(int x, int y, int z)
+    : x_(x),
+      y_(y),
+      z_(z),
+      epoch_(1) {
+  size_t nPoints = static_cast<size_t>(x) * y * z;
+
+  magnitudes_.reset(new std::atomic<float>[nPoints]);
+  stamps_.reset(new std::atomic<uint32_t>[nPoints]);
+
+  for (size_t i = 0; i < nPoints; ++i) {
+    stamps_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void MagnitudeCache::invalidate() {
+  if (++epoch_ != 0) return;
+
+  // After 2^32 - 1 epochs the stamps wrap round, so old ones would look current: clear them and start again
+  size_t nPoints = static_cast<size_t>(x_) * y_ * z_;
+  for (size_t i = 0; i < nPoints; ++i) {
+    stamps_[i].store(0, std::memory_order_relaxed);
+  }
+  epoch_ = 1;
+}
+
+void MagnitudeCache::invalidate(const GridBox &box) {
+  if (box.nPoints() == static_cast<size_t>(x_) * y_ * z_) {  // Quicker to forget the lot
+    invalidate();
+    return;
+  }
+
+#pragma omp parallel for collapse(2)
+  for (int x = box.x0; x <= box.x1; ++x) {
+    for (int y = box.y0; y <= box.y1; ++y) {
+      for (int z = box.z0; z <= box.z1; ++z) {
+        stamps_[index(x, y, z)].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
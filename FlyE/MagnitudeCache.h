@@ -0,0 +1,92 @@
+/**@file MagnitudeCache.h
+ * @brief This file contains the MagnitudeCache class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "GridBox.h"
+
+/** @brief Remembers the field magnitude at each grid point, for as long as the voltages don't change
+ *
+ * Dense (one slot per grid point) so that lookups are just an index, and lock-free so that any number of threads can fill it
+ * at once. Each slot has an epoch stamp: a slot is only valid if its stamp is the current epoch, so the whole cache is
+ * invalidated by bumping the epoch. If two threads fill the same slot at once they write the same value, so that's harmless.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class MagnitudeCache {
+ protected:
+  ///@{ @brief Dimensions of the grid
+  int x_, y_, z_;  ///@}
+  std::unique_ptr<std::atomic<float>[]> magnitudes_; //!< The remembered magnitudes (z varying fastest)
+  std::unique_ptr<std::atomic<uint32_t>[]> stamps_; //!< The epoch in which each magnitude was stored (0 for never)
+  uint32_t epoch_; //!< The current epoch
+
+  /** @brief The index of a point's slot */
+  inline size_t index(int x, int y, int z) const {
+    return (static_cast<size_t>(x) * y_ + y) * z_ + z;
+  }
+
+ public:
+  /** @brief Makes an empty cache for a grid
+   *
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   */
+  MagnitudeCache(int x, int y, int z);
+
+  /** @brief Whether a point is in the grid (and so can be cached) */
+  inline bool contains(int x, int y, int z) const {
+    return x >= 0 && y >= 0 && z >= 0 && x < x_ && y < y_ && z < z_;
+  }
+
+  /** @brief Looks up the magnitude at a point
+   *
+   * @param x x-coordinate of the point (which must be in the grid)
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param[out] magnitude The magnitude, if it's been stored this epoch
+   * @return true if the magnitude has been stored this epoch
+   */
+  inline bool lookup(int x, int y, int z, float &magnitude) const {
+    size_t i = index(x, y, z);
+    if (stamps_[i].load(std::memory_order_acquire) != epoch_) return false;
+
+    magnitude = magnitudes_[i].load(std::memory_order_relaxed);
+    return true;
+  }
+
+  /** @brief Stores the magnitude at a point for the rest of this epoch
+   *
+   * @param x x-coordinate of the point (which must be in the grid)
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param magnitude The magnitude of the field there
+   */
+  inline void store(int x, int y, int z, float magnitude) {
+    size_t i = index(x, y, z);
+    magnitudes_[i].store(magnitude, std::memory_order_relaxed);
+    stamps_[i].store(epoch_, std::memory_order_release);  // Publishes the magnitude with it
+  }
+
+  /** @brief Forgets every magnitude, by starting a new epoch
+   *
+   * Must not be called while other threads are using the cache.
+   */
+  void invalidate();
+
+  /** @brief Forgets the magnitudes in part of the grid
+   *
+   * Must not be called while other threads are using the cache.
+   *
+   * @param box The points to forget (which must be in the grid)
+   */
+  void invalidate(const GridBox &box);
+};
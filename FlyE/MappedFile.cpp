@@ -0,0 +1,57 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path)
+    : path_(path) {
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd < 0) return;
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (mapping != MAP_FAILED) {
+      data_ = static_cast<const char*>(mapping);
+      size_ = info.st_size;
+    }
+  }
+
+  close(fd);  // The mapping keeps its own reference to the file
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool MappedFile::isOpen() const {
+  return data_ != nullptr;
+}
+
+const char* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const {
+  if (data_ == nullptr || offset >= size_) return;
+
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t start = offset - offset % pageSize;  // madvise needs a page-aligned address
+  length = std::min(length + offset - start, size_ - start);
+
+  madvise(const_cast<char*>(data_) + start, length, MADV_WILLNEED);
+}
+
+const std::string& MappedFile::path() const {
+  return path_;
+}
@@ -0,0 +1,71 @@
+/**@file MappedFile.h
+ * @brief This file contains the MappedFile class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/** @brief A read-only memory mapping of a whole file
+ *
+ * The mapping is shared, so every process that maps the same file uses the same pages of the OS page cache.
+ * The file is unmapped when the object is destroyed. If the file can't be opened (or is empty), isOpen() is false.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class MappedFile {
+ protected:
+  std::string path_; //!< The path of the mapped file
+  const char *data_ = nullptr; //!< The start of the mapping, or nullptr if it failed
+  size_t size_ = 0; //!< The size of the mapping (bytes)
+
+ public:
+  /** @brief Maps the file at the given path
+   *
+   * @param path Path to the file to map
+   */
+  MappedFile(const std::string &path);
+
+  ~MappedFile(); //!< Unmaps the file
+
+  /** @brief Mappings can't be copied */
+  ///@{
+  MappedFile(const MappedFile &file) = delete;
+  MappedFile& operator =(const MappedFile &file) = delete;
+  ///@}
+
+  /** @brief Whether the file was mapped successfully
+   *
+   * @return true if the mapping exists
+   */
+  bool isOpen() const;
+
+  /** @brief The start of the mapped file
+   *
+   * @return A pointer to the first byte of the file
+   */
+  const char* data() const;
+
+  /** @brief The size of the mapped file
+   *
+   * @return The size of the file in bytes
+   */
+  size_t size() const;
+
+  /** @brief Asks the OS to start reading part of the file into memory
+   *
+   * Returns straight away; the pages are read in the background.
+   *
+   * @param offset The start of the part to read (bytes)
+   * @param length The length of the part to read (bytes)
+   */
+  void prefetch(size_t offset, size_t length) const;
+
+  /** @brief The path of the mapped file
+   *
+   * @return The path that was mapped
+   */
+  const std::string& path() const;
+};
@@ -0,0 +1,315 @@
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <new>
+#include <omp.h>
+#include <utility>
+
+#include "PhysicalConstants.h"
+
+namespace {
+
+constexpr int RADIX_BITS = 8;
+constexpr int RADIX = 1 << RADIX_BITS;
+
+// Spreads the low 21 bits of v out to every third bit
+uint64_t spreadBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// The grid point nearest a coordinate, on the grid
+uint64_t cellOf(float coordinate, int size) {
+  return std::min(std::max(static_cast<int>(std::round(coordinate)), 0), size - 1);
+}
+
+}
+
+constexpr size_t ParticleStore::ALIGNMENT;
+
+void* ParticleStore::allocateBytes(size_t bytes) {
+  void *memory = nullptr;
+  bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;  // Whole vectors, so the kernel can't read off the end
+
+  if (posix_memalign(&memory, ALIGNMENT, (bytes == 0) ? ALIGNMENT : bytes) != 0) {
+    std::cout << "Error allocating the particle store (" << bytes / 1e6 << " MB per array)" << std::endl;
+    throw std::bad_alloc();
+  }
+
+  return memory;
+}
+
+ParticleStore::ParticleStore(std::vector<AntiHydrogen> &particles)
+    : particles_(particles),
+      size_(particles.size()),
+      nLive_(particles.size()),
+      position_ { allocate<float>(size_), allocate<float>(size_), allocate<float>(size_) },
+      velocity_ { allocate<float>(size_), allocate<float>(size_), allocate<float>(size_) },
+      acceleration_ { allocate<float>(size_), allocate<float>(size_), allocate<float>(size_) },
+      coefficient_(allocate<float>(size_)),
+      ITlim_(allocate<float>(size_)),
+      ionisationLim_(allocate<float>(size_)),
+      maxField_(allocate<float>(size_)),
+      pendingKick_(allocate<float>(size_)),
+      status_(allocate<int>(size_)),
+      id_(allocate<uint32_t>(size_)),
+      sources_(allocate<uint32_t>(size_)),
+      floatScratch_(allocate<float>(size_)),
+      intScratch_(allocate<int>(size_)),
+      idScratch_(allocate<uint32_t>(size_)) {
+
+#pragma omp parallel for
+  for (size_t i = 0; i < size_; ++i) {
+    AntiHydrogen &particle = particles_[i];
+
+    position_[0].get()[i] = particle.getLocDim<0>();
+    position_[1].get()[i] = particle.getLocDim<1>();
+    position_[2].get()[i] = particle.getLocDim<2>();
+    velocity_[0].get()[i] = particle.getVelDim<0>();
+    velocity_[1].get()[i] = particle.getVelDim<1>();
+    velocity_[2].get()[i] = particle.getVelDim<2>();
+    acceleration_[0].get()[i] = acceleration_[1].get()[i] = acceleration_[2].get()[i] = 0.0;
+
+    coefficient_.get()[i] = particle.mu() / Physics::mH;
+    ITlim_.get()[i] = particle.ITlim();
+    ionisationLim_.get()[i] = particle.ionisationLim();
+    maxField_.get()[i] = particle.maxField();
+    pendingKick_.get()[i] = 0.0;
+
+    status_.get()[i] = (particle.succeeded()) ? SUCCEEDED :
+                       (particle.isDead() == 2) ? IONISED : (particle.isDead()) ? COLLIDED : FLYING;
+    id_.get()[i] = i;
+  }
+
+  compact();  // In case any have already stopped
+}
+
+size_t ParticleStore::size() const {
+  return size_;
+}
+
+size_t ParticleStore::nLive() const {
+  return nLive_;
+}
+
+template<typename T>
+void ParticleStore::gather(Array<T> &array, Array<T> &scratch, size_t n) {
+  const T *from = array.get();
+  T *to = scratch.get();
+  const uint32_t *sources = sources_.get();
+
+#pragma omp parallel for schedule(static)
+  for (size_t k = 0; k < n; ++k) {
+    to[k] = from[sources[k]];
+  }
+
+  std::swap(array, scratch);
+}
+
+size_t ParticleStore::compact() {
+  // Each thread finds the flying particles in its share of the slots, then they're numbered in order across the threads
+  std::vector<size_t> offsets(omp_get_max_threads() + 1, 0);
+  size_t nFlying = 0;  // The team can be smaller than the most threads, so offsets.back() isn't necessarily the total
+  const int *status = status_.get();
+  uint32_t *sources = sources_.get();
+
+#pragma omp parallel
+  {
+    const int thread = omp_get_thread_num(), nThreads = omp_get_num_threads();
+    const size_t begin = nLive_ * thread / nThreads, end = nLive_ * (thread + 1) / nThreads;
+
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+      count += (status[i] == FLYING);
+    }
+    offsets[thread + 1] = count;
+
+#pragma omp barrier
+#pragma omp single
+    {
+      for (int t = 0; t < nThreads; ++t) {
+        offsets[t + 1] += offsets[t];
+      }
+      nFlying = offsets[nThreads];
+    }
+
+    size_t k = offsets[thread];
+    for (size_t i = begin; i < end; ++i) {
+      if (status[i] == FLYING) sources[k++] = i;
+    }
+  }
+
+  if (nFlying == nLive_) return nLive_;
+
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+    gather(position_[d], floatScratch_, nFlying);
+    gather(velocity_[d], floatScratch_, nFlying);
+    gather(acceleration_[d], floatScratch_, nFlying);
+  }
+  gather(coefficient_, floatScratch_, nFlying);
+  gather(ITlim_, floatScratch_, nFlying);
+  gather(ionisationLim_, floatScratch_, nFlying);
+  gather(maxField_, floatScratch_, nFlying);
+  gather(pendingKick_, floatScratch_, nFlying);
+  gather(status_, intScratch_, nFlying);
+  gather(id_, idScratch_, nFlying);
+
+  nLive_ = nFlying;
+  return nLive_;
+}
+
+void ParticleStore::sortByCell(int x, int y, int z) {
+  const size_t n = nLive_;
+  if (n < 2) return;
+
+  int bits = 1;  // Per dimension
+  while ((1 << bits) < std::max(std::max(x, y), z)) ++bits;
+  const int nPasses = (3 * std::min(bits, 21) + RADIX_BITS - 1) / RADIX_BITS;
+
+  std::vector<uint64_t> keys(n), sortedKeys(n);
+  uint32_t *order = sources_.get(), *sortedOrder = idScratch_.get();
+
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n; ++i) {
+    keys[i] = spreadBits(cellOf(position_[0].get()[i], x)) << 2 | spreadBits(cellOf(position_[1].get()[i], y)) << 1
+        | spreadBits(cellOf(position_[2].get()[i], z));
+    order[i] = i;
+  }
+
+  // Least significant digit first; each thread counts its own share, so the sort is stable whatever the thread count
+  std::vector<size_t> counts(static_cast<size_t>(omp_get_max_threads()) * RADIX);
+
+  for (int pass = 0; pass < nPasses; ++pass) {
+    const int shift = pass * RADIX_BITS;
+
+#pragma omp parallel
+    {
+      const int thread = omp_get_thread_num(), nThreads = omp_get_num_threads();
+      const size_t begin = n * thread / nThreads, end = n * (thread + 1) / nThreads;
+      size_t *count = &counts[static_cast<size_t>(thread) * RADIX];
+
+      std::fill(count, count + RADIX, 0);
+      for (size_t i = begin; i < end; ++i) {
+        ++count[(keys[i] >> shift) & (RADIX - 1)];
+      }
+
+#pragma omp barrier
+#pragma omp single
+      {
+        size_t offset = 0;
+        for (int digit = 0; digit < RADIX; ++digit) {
+          for (int t = 0; t < nThreads; ++t) {
+            size_t c = counts[static_cast<size_t>(t) * RADIX + digit];
+            counts[static_cast<size_t>(t) * RADIX + digit] = offset;
+            offset += c;
+          }
+        }
+      }
+
+      for (size_t i = begin; i < end; ++i) {
+        size_t to = count[(keys[i] >> shift) & (RADIX - 1)]++;
+        sortedKeys[to] = keys[i];
+        sortedOrder[to] = order[i];
+      }
+    }
+
+    std::swap(keys, sortedKeys);
+    std::swap(order, sortedOrder);
+  }
+
+  if (order != sources_.get()) std::swap(sources_, idScratch_);  // gather() moves from sources_
+
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+    gather(position_[d], floatScratch_, n);
+    gather(velocity_[d], floatScratch_, n);
+    gather(acceleration_[d], floatScratch_, n);
+  }
+  gather(coefficient_, floatScratch_, n);
+  gather(ITlim_, floatScratch_, n);
+  gather(ionisationLim_, floatScratch_, n);
+  gather(maxField_, floatScratch_, n);
+  gather(pendingKick_, floatScratch_, n);
+  gather(status_, intScratch_, n);
+  gather(id_, idScratch_, n);
+}
+
+void ParticleStore::collide(size_t i) {
+  flushKick(i);
+  sync(i);
+  status_.get()[i] = COLLIDED;
+  particles_[id(i)].collide();
+}
+
+void ParticleStore::ionise(size_t i) {
+  flushKick(i);
+  sync(i);
+  status_.get()[i] = IONISED;
+  particles_[id(i)].ionise();
+}
+
+void ParticleStore::succeed(size_t i) {
+  flushKick(i);
+  sync(i);
+  status_.get()[i] = SUCCEEDED;
+  particles_[id(i)].succeed();
+}
+
+bool ParticleStore::neutralise(size_t i, int t) {
+  AntiHydrogen &particle = particles_[id(i)];
+  if (particle.isNeutralised()) return false;
+
+  particle.neutralise(t);
+  return true;
+}
+
+void ParticleStore::push(float timeStep) {
+  const float halfStepSquared = 0.5 * timeStep * timeStep;
+  const long n = nLive_;
+  const int *__restrict__ status = status_.get();
+
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+    float *__restrict__ r = static_cast<float*>(__builtin_assume_aligned(position_[d].get(), ALIGNMENT));
+    float *__restrict__ v = static_cast<float*>(__builtin_assume_aligned(velocity_[d].get(), ALIGNMENT));
+    const float *__restrict__ a = static_cast<const float*>(__builtin_assume_aligned(acceleration_[d].get(), ALIGNMENT));
+
+    // Branch free, so it vectorises: particles that aren't flying move by nothing
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      const float flying = (status[i] == FLYING) ? 1.0f : 0.0f;
+      const float newV = v[i] + flying * a[i] * timeStep;
+
+      v[i] = newV;
+      r[i] += flying * (newV * timeStep + a[i] * halfStepSquared) * Physics::MM_M_FACTOR;
+    }
+  }
+}
+
+void ParticleStore::sync(size_t i) {
+  AntiHydrogen &particle = particles_[id(i)];
+
+  particle.setLoc(position_[0].get()[i], position_[1].get()[i], position_[2].get()[i]);
+  const float pending = pendingKick_.get()[i];
+  particle.setVel(velocity_[0].get()[i] + acceleration_[0].get()[i] * pending,
+                  velocity_[1].get()[i] + acceleration_[1].get()[i] * pending,
+                  velocity_[2].get()[i] + acceleration_[2].get()[i] * pending);
+  particle.checkMaxField(maxField_.get()[i]);
+}
+
+void ParticleStore::syncAll() {
+#pragma omp parallel for
+  for (size_t i = 0; i < nLive_; ++i) {
+    sync(i);
+  }
+}
+
+AntiHydrogen& ParticleStore::particle(size_t i) {
+  sync(i);
+  return particles_[id(i)];
+}
@@ -0,0 +1,269 @@
+/**@file ParticleStore.h
+ * @brief This file contains the ParticleStore class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "AntiHydrogen.h"
+#include "PhysicalConstants.h"
+
+/** @brief The state that the Simulator updates every step, for every particle, as separate arrays
+ *
+ * An AntiHydrogen carries its trajectory and everything else about it around with it, so looping over a vector of them
+ * strides through a couple of hundred bytes per particle and can't be vectorised. The store copies out just what the time
+ * step needs (position, velocity, acceleration, status and the constants that the field is compared with) into aligned
+ * arrays, one per quantity, so that push() can move 8-16 particles at a time.
+ *
+ * The AntiHydrogens are still the record of each particle (its trajectory and fate, for the Writer). Fates are passed on
+ * to them straight away (see collide() etc.), and particle() syncs the rest of the state back before handing one out.
+ *
+ * Particles are kept in slots, and only the first nLive() slots are looked at. Every so often, compact() moves the
+ * particles that are still flying to the front (in order) and drops the rest, whose AntiHydrogens already have their final
+ * state, so that the cost of a step goes with the number of particles left. id() maps each slot back to its AntiHydrogen.
+ *
+ * The particles start in the order they were generated, so neighbouring slots look up unrelated parts of the field.
+ * sortByCell() reorders the live slots along a Morton (Z-order) curve through the grid cells, so that particles that are
+ * close in space are close in the arrays too, and each thread's share of the loop touches a compact part of the field.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class ParticleStore {
+ public:
+  /** @brief What's happened to a particle */
+  enum Status : int {
+    FLYING = 0, //!< Still flying
+    COLLIDED, //!< Hit an electrode or left the sides of the grid
+    IONISED, //!< Ionised by a strong field
+    SUCCEEDED //!< Reached the end of the accelerator
+  };
+
+  static constexpr size_t ALIGNMENT = 64; //!< Alignment of each array (a cache line, and an AVX-512 register)
+
+ protected:
+  /** @brief An aligned array, freed with std::free() */
+  template<typename T>
+  using Array = std::unique_ptr<T, decltype(&std::free)>;
+
+  std::vector<AntiHydrogen> &particles_; //!< The particles that the state is copied from (and synced back to)
+  size_t size_; //!< The number of particles
+  size_t nLive_; //!< The number of slots in use (the flying particles, and any that have stopped since compact())
+  ///@{ @brief Position (grid spacings), velocity (m/s) and acceleration (m/s^2) in x, y and z, in each slot
+  Array<float> position_[3], velocity_[3], acceleration_[3];  ///@}
+  Array<float> coefficient_; //!< The acceleration per unit field gradient (dipole moment / mass)
+  Array<float> ITlim_; //!< The Inglis-Teller limit
+  Array<float> ionisationLim_; //!< The ionisation limit
+  Array<float> maxField_; //!< The largest field magnitude encountered
+  Array<float> pendingKick_; //!< How long the last kick of a symplectic step still has to last (s, see pendingKick())
+  Array<int> status_; //!< The Status of the particle in each slot
+  Array<uint32_t> id_; //!< The index of the AntiHydrogen in each slot
+  Array<uint32_t> sources_; //!< Where compact() moves each slot from
+  Array<float> floatScratch_; //!< Somewhere for compact() to move float arrays to
+  Array<int> intScratch_; //!< Somewhere for compact() to move int arrays to
+  Array<uint32_t> idScratch_; //!< Somewhere for compact() to move id_ to (and for sortByCell() to sort into)
+
+  /** @brief Allocates an aligned array
+   *
+   * @param n The number of elements
+   * @return The array (throws std::bad_alloc if it can't be allocated)
+   */
+  template<typename T>
+  static Array<T> allocate(size_t n) {
+    return Array<T>(static_cast<T*>(allocateBytes(n * sizeof(T))), std::free);
+  }
+
+  /** @brief Allocates aligned memory, rounded up to a whole number of cache lines
+   *
+   * @param bytes The size of the memory
+   * @return The memory (throws std::bad_alloc if it can't be allocated)
+   */
+  static void* allocateBytes(size_t bytes);
+
+  /** @brief Moves the first nLive() slots of an array to where sources_ says, through a scratch array
+   *
+   * @param array The array to move
+   * @param scratch An array the same size, which is swapped with it
+   * @param n The number of slots that are kept
+   */
+  template<typename T>
+  void gather(Array<T> &array, Array<T> &scratch, size_t n);
+
+ public:
+  /** @brief Copies the particles' state into the store
+   *
+   * @param particles The particles, which must outlive the store (and not be added to or removed)
+   */
+  ParticleStore(std::vector<AntiHydrogen> &particles);
+
+  /** @brief The number of particles */
+  size_t size() const;
+
+  /** @brief The number of slots in use: every particle that's flying, and maybe some that have stopped since compact() */
+  size_t nLive() const;
+
+  /** @brief The index (in the vector of AntiHydrogens) of the particle in a slot */
+  inline uint32_t id(size_t i) const {
+    return id_.get()[i];
+  }
+
+  /** @brief Moves the flying particles to the front slots, keeping them in order, and drops the rest
+   *
+   * Runs in parallel. Does nothing if no particle has stopped since it last ran.
+   *
+   * @return The number of particles still flying (the new nLive())
+   */
+  size_t compact();
+
+  /** @brief Reorders the live slots by the Morton (Z-order) key of the grid point nearest each particle
+   *
+   * The keys are sorted with a stable parallel radix sort (only as many 8-bit passes as the grid's size needs), so the
+   * order is the same for any number of threads. Particles outside the grid are keyed by the nearest point on its edge.
+   *
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   */
+  void sortByCell(int x, int y, int z);
+
+  ///@{
+  /** @brief The array of one component of position, velocity or acceleration, by slot
+   *
+   * @param d The dimension: 0 for x, 1 for y, 2 for z
+   * @return The first particle's component
+   */
+  inline float* position(int d) {
+    return position_[d].get();
+  }
+  inline float* velocity(int d) {
+    return velocity_[d].get();
+  }
+  inline float* acceleration(int d) {
+    return acceleration_[d].get();
+  }
+  ///@}
+
+  /** @brief How long the last kick of a particle's previous step still has to be applied for (s)
+   *
+   * A symplectic step ends with a kick at the particle's new position, which the Simulator leaves until the next step has
+   * looked the acceleration up there anyway (see Integrator). Until then, the store's velocity is behind by that kick; sync()
+   * estimates it with the last acceleration looked up, and a particle's fate (collide() etc) applies it. 0 to begin with.
+   *
+   * @param i The slot of the particle
+   */
+  inline float& pendingKick(size_t i) {
+    return pendingKick_.get()[i];
+  }
+
+  /** @brief Applies a particle's pending kick with the last acceleration looked up for it
+   *
+   * @param i The slot of the particle
+   */
+  inline void flushKick(size_t i) {
+    for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+      velocity_[d].get()[i] += acceleration_[d].get()[i] * pendingKick_.get()[i];
+    }
+    pendingKick_.get()[i] = 0.0;
+  }
+
+  ///@{
+  /** @brief Moves one particle, for a part of a time step
+   *
+   * kick() changes the velocity by an acceleration, drift() moves the position by the velocity, and eulerStep() does both
+   * the way push() does.
+   *
+   * @param i The slot of the particle
+   * @param a The acceleration in x, y and z (m/s^2)
+   * @param duration How long to kick or drift for (s)
+   */
+  inline void kick(size_t i, const float a[3], float duration) {
+    for (int d = 0; d < Physics::N_DIMENSIONS; ++d) velocity_[d].get()[i] += a[d] * duration;
+  }
+  inline void drift(size_t i, float duration) {
+    for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+      position_[d].get()[i] += velocity_[d].get()[i] * duration * Physics::MM_M_FACTOR;
+    }
+  }
+  inline void eulerStep(size_t i, const float a[3], float duration) {
+    for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+      float v = velocity_[d].get()[i] += a[d] * duration;
+      position_[d].get()[i] += (v * duration + a[d] * 0.5f * duration * duration) * Physics::MM_M_FACTOR;
+    }
+  }
+  ///@}
+
+  /** @brief Whether the particle in a slot is still flying */
+  inline bool isFlying(size_t i) const {
+    return status_.get()[i] == FLYING;
+  }
+
+  /** @brief A particle's acceleration per unit field gradient */
+  inline float coefficient(size_t i) const {
+    return coefficient_.get()[i];
+  }
+
+  /** @brief A particle's Inglis-Teller limit */
+  inline float ITlim(size_t i) const {
+    return ITlim_.get()[i];
+  }
+
+  /** @brief A particle's ionisation limit */
+  inline float ionisationLim(size_t i) const {
+    return ionisationLim_.get()[i];
+  }
+
+  /** @brief Remembers a field magnitude if it's the biggest a particle has encountered */
+  inline void checkMaxField(size_t i, float magnitude) {
+    if (magnitude > maxField_.get()[i]) maxField_.get()[i] = magnitude;
+  }
+
+  ///@{
+  /** @brief Ends a particle's flight, applying any pending kick, syncing it and passing the fate on to its AntiHydrogen
+   *
+   * @param i The slot of the particle
+   */
+  void collide(size_t i);
+  void ionise(size_t i);
+  void succeed(size_t i);
+  ///@}
+
+  /** @brief Neutralises a particle's AntiHydrogen, unless it already has been
+   *
+   * @param i The slot of the particle
+   * @param t The time step that it's neutralised at
+   * @return true if it has just been neutralised
+   */
+  bool neutralise(size_t i, int t);
+
+  /** @brief Moves every flying particle (in the first nLive() slots) by one time step with its acceleration
+   *
+   * The same update as the Simulator always used: the velocity is updated first, and the position moves by the new velocity
+   * plus half the acceleration times the time step squared. Particles that aren't flying don't move.
+   *
+   * @param timeStep The time step (s)
+   */
+  void push(float timeStep);
+
+  /** @brief Copies a particle's state back to its AntiHydrogen
+   *
+   * The velocity includes any pending kick, with the last acceleration looked up (the store's velocity doesn't change).
+   *
+   * @param i The slot of the particle
+   */
+  void sync(size_t i);
+
+  /** @brief Copies every live slot's state back to its AntiHydrogen (the others already have their final state) */
+  void syncAll();
+
+  /** @brief A particle's AntiHydrogen, synced
+   *
+   * @param i The slot of the particle
+   * @return The AntiHydrogen, with the store's current state
+   */
+  AntiHydrogen& particle(size_t i);
+};
@@ -0,0 +1,231 @@
+#include "PhaseTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "FieldCache.h"
+#include "GradientField.h"
+#include "SubConfig.h"
+
+namespace {
+
+constexpr char MAGIC[8] = "FLYEPT"; // Padded with nulls
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+// FNV-1a, continuing from hash
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+}
+
+constexpr int PhaseTable::RECORD_SIZE;
+
+PhaseTable::PhaseTable(std::shared_ptr<AcceleratorConfig> config, const std::vector<std::vector<float> > &patterns,
+                       int nPhases)
+    : config_(config),
+      nPhases_(nPhases),
+      x_(config->x()),
+      y_(config->y()),
+      z_(config->z()),
+      checksum_(FieldCache::sourceChecksum(config)) {
+  for (auto &pattern : patterns) {
+    checksum_ = fnv1a(pattern.data(), pattern.size() * sizeof(float), checksum_);
+  }
+}
+
+std::string PhaseTable::path() const {
+  return config_->datDirectory() + config_->PAname() + ".ptable";
+}
+
+void PhaseTable::makeHeader(PhaseTableHeader &header) const {
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+
+  header.version = VERSION;
+  header.nPhases = nPhases_;
+  header.x = x_;
+  header.y = y_;
+  header.z = z_;
+  std::strncpy(header.PAname, config_->PAname().c_str(), sizeof(header.PAname) - 1);
+  header.checksum = checksum_;
+  header.dataOffset = FieldCache::ALIGNMENT;
+}
+
+bool PhaseTable::load() {
+  file_.reset(new MappedFile(path()));
+
+  if (!file_->isOpen() || file_->size() < sizeof(PhaseTableHeader)) {
+    file_.reset();
+    return false;
+  }
+
+  const PhaseTableHeader &header = *reinterpret_cast<const PhaseTableHeader*>(file_->data());
+  PhaseTableHeader expected;
+  makeHeader(expected);
+
+  if (std::memcmp(&header, &expected, sizeof(header)) != 0 || file_->size() < header.dataOffset + size()) {
+    std::cout << "Phase table " << path() << " is stale; rebuilding it" << std::endl;
+    file_.reset();
+    return false;
+  }
+
+  records_ = reinterpret_cast<const float*>(file_->data() + header.dataOffset);
+  return true;
+}
+
+bool PhaseTable::ready() const {
+  return records_ != nullptr;
+}
+
+void PhaseTable::build(const VectorField &cosine, const VectorField &sine) {
+  PhaseTableHeader header;
+  makeHeader(header);
+
+  // The records go straight into a mapping of the file, so the kernel can write them out (and drop them) as they're
+  // filled, rather than the whole table sitting in memory until it's written
+  std::string tempPath = path() + ".tmp" + std::to_string(getpid());
+  const size_t fileSize = header.dataOffset + size();
+  int fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  void *mapping = MAP_FAILED;
+
+  if (fd >= 0 && ftruncate(fd, fileSize) == 0) {
+    mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  if (fd >= 0) close(fd);  // The mapping keeps its own reference to the file
+
+  if (mapping == MAP_FAILED) {
+    std::cout << "Error writing phase table: " << tempPath << " (" << size() / 1e6 << " MB)" << std::endl;
+    std::remove(tempPath.c_str());
+    throw std::bad_alloc();
+  }
+
+  std::memcpy(mapping, &header, sizeof(header));
+  float *records = reinterpret_cast<float*>(static_cast<char*>(mapping) + header.dataOffset);
+
+  const long nPoints = static_cast<long>(x_) * y_ * z_;
+  VectorField trap(x_, y_, z_);
+  GradientField gradients(x_, y_, z_);
+
+  const float *cosineData = reinterpret_cast<const float*>(cosine.data());
+  const float *sineData = reinterpret_cast<const float*>(sine.data());
+  float *trapData = reinterpret_cast<float*>(trap.data());
+
+  for (int p = 0; p < nPhases_; ++p) {
+    const float angle = 2 * M_PI * p / nPhases_;
+    const float c = std::cos(angle), s = std::sin(angle);
+
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < 3 * nPoints; ++i) {
+      trapData[i] = c * cosineData[i] + s * sineData[i];
+    }
+
+    gradients.invalidate(gradients.all());
+    gradients.refresh(trap, 0, z_ - 1);
+
+#pragma omp parallel for collapse(2)
+    for (int x = 0; x < x_; ++x) {
+      for (int y = 0; y < y_; ++y) {
+        for (int z = 0; z < z_; ++z) {
+          float magnitude;
+          blitz::TinyVector<float, 3> gradient;
+          gradients.nodeAt(x, y, z, magnitude, gradient);
+
+          float *record = &records[(index(x, y, z) * nPhases_ + p) * RECORD_SIZE];
+          record[0] = magnitude;
+          record[1] = gradient[0];
+          record[2] = gradient[1];
+          record[3] = gradient[2];
+        }
+      }
+    }
+  }
+
+  munmap(mapping, fileSize);
+
+  // Kept next to the field cache if it's in use (renamed, so other processes never see a partial table); otherwise the
+  // file is only needed until it's mapped again read-only
+  bool keep = config_->useFieldCache() && std::rename(tempPath.c_str(), path().c_str()) == 0;
+  if (config_->useFieldCache() && !keep) std::cout << "Error writing phase table: " << path() << std::endl;
+
+  file_.reset(new MappedFile((keep) ? path() : tempPath));
+  if (!keep) std::remove(tempPath.c_str());
+
+  if (!file_->isOpen()) {
+    std::cout << "Error mapping phase table: " << file_->path() << std::endl;
+    throw std::bad_alloc();
+  }
+
+  records_ = reinterpret_cast<const float*>(file_->data() + header.dataOffset);
+  if (keep) std::cout << "Wrote phase table " << path() << std::endl;
+}
+
+int PhaseTable::nPhases() const {
+  return nPhases_;
+}
+
+size_t PhaseTable::size() const {
+  return sizeof(float) * RECORD_SIZE * nPhases_ * static_cast<size_t>(x_) * y_ * z_;
+}
+
+PhaseTable::Phase PhaseTable::phase(float cosine, float sine) const {
+  Phase phase;
+  float voltage = std::hypot(cosine, sine);
+  if (voltage == 0.0) return phase;  // No weight on anything, so the field is zero
+
+  float angle = std::atan2(sine, cosine);
+  if (angle < 0) angle += 2 * M_PI;
+
+  float position = angle * nPhases_ / (2 * M_PI);
+  float below = std::floor(position);
+
+  phase.low = static_cast<size_t>(below) % nPhases_;
+  phase.high = (phase.low + 1) % nPhases_;
+  phase.highWeight = voltage * (position - below);
+  phase.lowWeight = voltage - phase.highWeight;
+
+  return phase;
+}
+
+void PhaseTable::sample(float x, float y, float z, const Phase &phase, float &magnitude,
+                        blitz::TinyVector<float, 3> &gradient) const {
+  // The cell that the point is in, and how far across it the point is
+  int cell[3];
+  float weight[3];
+  const float position[3] = { x, y, z };
+  const int size[3] = { x_, y_, z_ };
+
+  for (int d = 0; d < 3; ++d) {
+    float clamped = std::min(std::max(position[d], 0.0f), static_cast<float>(size[d] - 1));
+    cell[d] = std::min(static_cast<int>(clamped), size[d] - 2);
+    weight[d] = clamped - cell[d];
+  }
+
+  magnitude = 0.0;
+  gradient = 0.0;
+
+  for (int corner = 0; corner < 8; ++corner) {
+    int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+    float w = ((dx) ? weight[0] : 1 - weight[0]) * ((dy) ? weight[1] : 1 - weight[1])
+        * ((dz) ? weight[2] : 1 - weight[2]);
+
+    float cornerMagnitude;
+    blitz::TinyVector<float, 3> cornerGradient;
+    nodeAt(cell[0] + dx, cell[1] + dy, cell[2] + dz, phase, cornerMagnitude, cornerGradient);
+
+    magnitude += w * cornerMagnitude;
+    gradient += cornerGradient * w;
+  }
+}
@@ -0,0 +1,172 @@
+/**@file PhaseTable.h
+ * @brief This file contains the PhaseTable class and the PhaseTableHeader struct
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <blitz/tinyvec2.h>
+
+#include "MappedFile.h"
+#include "VectorField.h"
+
+class AcceleratorConfig;
+
+/** @brief The header at the start of every phase table file
+ *
+ * The records follow at dataOffset: for each grid point (with z varying fastest), for each phase, the magnitude of the
+ * field and its gradient in x, y and z, as four floats.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+struct PhaseTableHeader {
+  char magic[8]; //!< Always "FLYEPT" (null padded)
+  uint32_t version; //!< Version of the file layout
+  uint32_t nPhases; //!< Number of phases tabulated
+  ///@{ @brief x, y, z dimensions of the grid
+  int32_t x, y, z;  ///@}
+  char PAname[64]; //!< The PA name of the geometry (null terminated)
+  uint64_t checksum; //!< Checksum of the geometry's source files and the two voltage patterns
+  uint64_t dataOffset; //!< Offset of the first record from the start of the file (bytes)
+};
+
+/** @brief The magnitude of the field and its gradient at every grid point, for a range of trap phases
+ *
+ * When the voltages are always V (cos(phase) A + sin(phase) B) for two fixed patterns A and B (as in MovingTrapScheme), the
+ * magnitude of the field is |V| times the magnitude for a 1V trap at that phase, and so is its gradient. So rather than
+ * blending the field and recomputing its gradients every step, they can be tabulated once at nPhases evenly spaced phases,
+ * and looked up by interpolating linearly between the two phases either side (see phase()).
+ *
+ * Each point's records for every phase are stored together, so a lookup only touches one or two cache lines. The table
+ * is always read through a mapping of its file, so it never has to fit in memory. It doesn't depend on the maximum
+ * voltage, so it's kept next to the field cache and mapped by every later run with the same geometry, voltage patterns
+ * and number of phases.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class PhaseTable {
+ protected:
+  std::shared_ptr<AcceleratorConfig> config_; //!< The configuration of the geometry
+  int nPhases_; //!< The number of phases tabulated
+  ///@{ @brief Dimensions of the grid
+  int x_, y_, z_;  ///@}
+  uint64_t checksum_; //!< Checksum of the geometry's source files and the voltage patterns
+  std::unique_ptr<MappedFile> file_; //!< The mapped table
+  const float *records_ = nullptr; //!< The first record, in the mapping
+
+  /** @brief The index of a point in the grid */
+  inline size_t index(int x, int y, int z) const {
+    return (static_cast<size_t>(x) * y_ + y) * z_ + z;
+  }
+
+  /** @brief Fills in a header describing the table
+   *
+   * @param header The header to fill
+   */
+  void makeHeader(PhaseTableHeader &header) const;
+
+ public:
+  static constexpr uint32_t VERSION = 1; //!< The current version of the file layout
+  static constexpr int RECORD_SIZE = 4; //!< Floats per point per phase: the magnitude and the gradient in x, y and z
+
+  /** @brief Where to look up a phase: the two tabulated phases either side, and how much of each (times the voltage) */
+  struct Phase {
+    size_t low = 0; //!< The tabulated phase at or below
+    size_t high = 0; //!< The tabulated phase above
+    float lowWeight = 0.0; //!< The weight of the phase below
+    float highWeight = 0.0; //!< The weight of the phase above
+  };
+
+  /** @brief Sets up an empty table for a geometry and two voltage patterns
+   *
+   * @param config The configuration of the geometry
+   * @param patterns The cosine and sine voltage patterns (see VoltageScheme::modePatterns())
+   * @param nPhases The number of phases to tabulate
+   */
+  PhaseTable(std::shared_ptr<AcceleratorConfig> config, const std::vector< std::vector<float> > &patterns, int nPhases);
+
+  /** @brief Maps the table file and checks that it matches
+   *
+   * @return true if the table can be used, false if it doesn't exist or is stale
+   */
+  bool load();
+
+  /** @brief Whether the table has been loaded or built */
+  bool ready() const;
+
+  /** @brief Tabulates the field's magnitude and gradient at every phase, into the table file, and maps it
+   *
+   * The file is written to a temporary path through a shared mapping, one phase at a time, then renamed (so other
+   * processes never see a partial table) if the field cache is in use, or mapped and unlinked if not.
+   *
+   * @param cosine The field of the cosine pattern (at 1V)
+   * @param sine The field of the sine pattern (at 1V)
+   */
+  void build(const VectorField &cosine, const VectorField &sine);
+
+  /** @brief The path of the table file
+   *
+   * @return [dat_directory][pa_name].ptable
+   */
+  std::string path() const;
+
+  /** @brief The number of phases tabulated */
+  int nPhases() const;
+
+  /** @brief The size of the records (bytes) */
+  size_t size() const;
+
+  /** @brief Where to look up the field made with some pattern coefficients
+   *
+   * @param cosine How much of the cosine pattern there is (V cos(phase))
+   * @param sine How much of the sine pattern there is (V sin(phase))
+   * @return The tabulated phases either side, weighted by how close they are and by the voltage
+   */
+  Phase phase(float cosine, float sine) const;
+
+  /** @brief The magnitude of the field and its gradient at a grid point
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param phase Where to look up (see phase())
+   * @param[out] magnitude The magnitude of the field at the point (0 outside the grid)
+   * @param[out] gradient The gradient of the magnitude at the point (0 outside the grid)
+   */
+  inline void nodeAt(int x, int y, int z, const Phase &phase, float &magnitude,
+                     blitz::TinyVector<float, 3> &gradient) const {
+    if (x < 0 || y < 0 || z < 0 || x >= x_ || y >= y_ || z >= z_) {
+      magnitude = 0.0;
+      gradient = 0.0;
+      return;
+    }
+
+    const float *records = records_ + index(x, y, z) * nPhases_ * RECORD_SIZE;
+    const float *low = records + phase.low * RECORD_SIZE;
+    const float *high = records + phase.high * RECORD_SIZE;
+
+    magnitude = phase.lowWeight * low[0] + phase.highWeight * high[0];
+    gradient = blitz::TinyVector<float, 3>(phase.lowWeight * low[1] + phase.highWeight * high[1],
+                                           phase.lowWeight * low[2] + phase.highWeight * high[2],
+                                           phase.lowWeight * low[3] + phase.highWeight * high[3]);
+  }
+
+  /** @brief Interpolates the magnitude of the field and its gradient at a point
+   *
+   * @see GradientField::sample()
+   *
+   * @param x x-coordinate of the point (grid spacings)
+   * @param y y-coordinate of the point (grid spacings)
+   * @param z z-coordinate of the point (grid spacings)
+   * @param phase Where to look up (see phase())
+   * @param[out] magnitude The magnitude of the field at the point
+   * @param[out] gradient The gradient of the magnitude at the point
+   */
+  void sample(float x, float y, float z, const Phase &phase, float &magnitude,
+              blitz::TinyVector<float, 3> &gradient) const;
+};
@@ -0,0 +1,117 @@
+#include "PotentialArray.h"
+
+#include <iostream>
+#include <vector>
+
+#include "PhysicalConstants.h"
+
+PotentialArray::PotentialArray(const std::string &path)
+    : file_(path) {
+  static_assert(sizeof(PotentialArrayHeader) == 32, "PotentialArrayHeader must match SIMION's '=iidiiii'");
+
+  if (!file_.isOpen() || file_.size() < sizeof(PotentialArrayHeader)) {
+    std::cout << "Error reading .pa file: " << path << std::endl;
+    return;
+  }
+
+  const PotentialArrayHeader *header = reinterpret_cast<const PotentialArrayHeader*>(file_.data());
+
+  if (header->mode != -1 || (header->mirror & 7) != 0) {
+    std::cout << "Unsupported .pa file (only unmirrored mode -1 arrays can be read): " << path << std::endl;
+    return;
+  }
+
+  size_t nValues = static_cast<size_t>(header->nx) * header->ny * header->nz;
+  if (header->nx < 3 || header->ny < 3 || header->nz < 3
+      || file_.size() < sizeof(PotentialArrayHeader) + nValues * sizeof(double)) {
+    std::cout << "Truncated .pa file: " << path << std::endl;
+    return;
+  }
+
+  header_ = header;
+  values_ = reinterpret_cast<const double*>(file_.data() + sizeof(PotentialArrayHeader));
+}
+
+bool PotentialArray::isOpen() const {
+  return header_ != nullptr;
+}
+
+int PotentialArray::nx() const {
+  return header_->nx;
+}
+
+int PotentialArray::ny() const {
+  return header_->ny;
+}
+
+int PotentialArray::nz() const {
+  return header_->nz;
+}
+
+size_t PotentialArray::size() const {
+  return file_.size();
+}
+
+bool PotentialArray::isElectrode(int x, int y, int z) const {
+  return values_[(static_cast<size_t>(z) * header_->ny + y) * header_->nx + x] > header_->maxVoltage;
+}
+
+double PotentialArray::potential(int x, int y, int z) const {
+  double value = values_[(static_cast<size_t>(z) * header_->ny + y) * header_->nx + x];
+
+  return (value > header_->maxVoltage) ? value - 2 * header_->maxVoltage : value;
+}
+
+void PotentialArray::deriveField(float *fields, int sizeX, int sizeY, int sizeZ, double pixelSize) const {
+  deriveField(values_, header_->nx, header_->ny, header_->nz, header_->maxVoltage, fields, sizeX, sizeY, sizeZ, pixelSize);
+}
+
+void PotentialArray::deriveField(const double *values, int nx, int ny, int nz, double maxVoltage,
+                                 float *fields, int sizeX, int sizeY, int sizeZ, double pixelSize) {
+  const size_t rowStride = nx;
+  const size_t planeStride = rowStride * ny;
+  const float scale = Physics::SIMION_MULTIPLIER / (2 * pixelSize);
+
+#pragma omp parallel
+  {
+    // Decoded potentials of the rows around the current one, and the field along it
+    std::vector<double> row(nx), below(nx), above(nx), behind(nx), ahead(nx);
+    std::vector<float> fieldX(nx), fieldY(nx), fieldZ(nx);
+    std::vector<char> electrode(nx);
+
+    auto decode = [&](const double *raw, std::vector<double> &decoded) {
+      for (int x = 0; x < nx; ++x) {  // Branch-free, so it vectorises
+        decoded[x] = raw[x] - ((raw[x] > maxVoltage) ? 2 * maxVoltage : 0.0);
+      }
+    };
+
+#pragma omp for collapse(2) schedule(static)
+    for (int z = 0; z < sizeZ; ++z) {
+      for (int y = 0; y < sizeY; ++y) {
+        const double *raw = values + (z + 1) * planeStride + (y + 1) * rowStride;  // Interior point (0, y, z)
+
+        decode(raw, row);
+        decode(raw - rowStride, below);
+        decode(raw + rowStride, above);
+        decode(raw - planeStride, behind);
+        decode(raw + planeStride, ahead);
+
+        for (int x = 1; x < nx - 1; ++x) {  // The stencil, along the contiguous axis
+          fieldX[x] = scale * (row[x + 1] - row[x - 1]);
+          fieldY[x] = scale * (above[x] - below[x]);
+          fieldZ[x] = scale * (ahead[x] - behind[x]);
+          electrode[x] = raw[x] > maxVoltage;
+        }
+
+        for (int x = 0; x < sizeX; ++x) {  // Scatter into the Blitz++ layout (z varying fastest)
+          float *point = fields + ((static_cast<size_t>(x) * sizeY + y) * sizeZ + z) * Physics::N_DIMENSIONS;
+          bool inside = electrode[x + 1];
+
+          point[0] = (inside) ? 0.0 : fieldX[x + 1];
+          point[1] = (inside) ? 0.0 : fieldY[x + 1];
+          point[2] = (inside) ? 0.0 : fieldZ[x + 1];
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,120 @@
+/**@file PotentialArray.h
+ * @brief This file contains the PotentialArray class and the PotentialArrayHeader struct
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+
+/** @brief The header at the start of a SIMION potential array (.pa0, .pa#, .paN) file
+ *
+ * The same as makefields.py's struct.unpack('=iidiiii'). nx * ny * nz doubles follow it, with x varying fastest.
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+struct PotentialArrayHeader {
+  int32_t mode; //!< File format mode; only -1 is understood
+  int32_t symmetry; //!< 0 for cylindrical, 1 for planar
+  double maxVoltage; //!< Points with values above this are electrode points
+  ///@{ @brief Dimensions of the array
+  int32_t nx, ny, nz;  ///@}
+  int32_t mirror; //!< Mirroring flags (x, y and z in the lowest three bits)
+};
+
+/** @brief A memory-mapped SIMION potential array, from which the electric field can be derived
+ *
+ * SIMION marks electrode points by adding 2 * maxVoltage to their potential. This class undoes that, and derives the field
+ * with central differences, the same way EXSIMECK does. Only unmirrored arrays in the current format (mode -1) are
+ * understood.
+ *
+ * @see DatParser
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class PotentialArray {
+ protected:
+  MappedFile file_; //!< The mapped .pa file
+  const PotentialArrayHeader *header_ = nullptr; //!< The header of the mapped file (if it's valid)
+  const double *values_ = nullptr; //!< The raw values in the mapped file (if it's valid)
+
+ public:
+  /** @brief Maps the .pa file at the given path
+   *
+   * If it can't be read or isn't a potential array that's understood, isOpen() is false and the reason is printed.
+   *
+   * @param path Path to the .pa file
+   */
+  PotentialArray(const std::string &path);
+
+  /** @brief Whether the file was mapped and understood
+   *
+   * @return true if the potential array can be used
+   */
+  bool isOpen() const;
+
+  ///@{ @brief Dimensions of the array
+  int nx() const;
+  int ny() const;
+  int nz() const;
+  ///@}
+
+  /** @brief Whether a point is part of an electrode
+   *
+   * @param x x-index of the point
+   * @param y y-index of the point
+   * @param z z-index of the point
+   * @return true if the point is an electrode point
+   */
+  bool isElectrode(int x, int y, int z) const;
+
+  /** @brief The potential at a point
+   *
+   * @param x x-index of the point
+   * @param y y-index of the point
+   * @param z z-index of the point
+   * @return The potential (V), with electrode points decoded
+   */
+  double potential(int x, int y, int z) const;
+
+  /** @brief Derives the field on the interior of the array, in the layout that Electrode uses
+   *
+   * The interior leaves out the outermost layer of points on every side, so FlyE's (x, y, z) is the array's (x+1, y+1, z+1),
+   * the same as for the EXSIMECK .dat files. Each component is SIMION_MULTIPLIER times the central difference of the
+   * potential divided by the pixel size, and the field is zero at electrode points.
+   *
+   * @param fields The first float of the field, laid out like Blitz++ stores an Array<TinyVector<float, 3>, 3>
+   * @param sizeX The size of the field along x (nx - 2)
+   * @param sizeY The size of the field along y (ny - 2)
+   * @param sizeZ The size of the field along z (nz - 2)
+   * @param pixelSize The distance between points (mm)
+   */
+  void deriveField(float *fields, int sizeX, int sizeY, int sizeZ, double pixelSize) const;
+
+  /** @brief Derives the field from potentials in memory, encoded the same way as a .pa file
+   *
+   * @see deriveField(float*, int, int, int, double) const
+   *
+   * @param values nx * ny * nz potentials (x varying fastest), with electrode points marked by adding 2 * maxVoltage
+   * @param nx The size of the potential array along x
+   * @param ny The size of the potential array along y
+   * @param nz The size of the potential array along z
+   * @param maxVoltage Points with values above this are electrode points
+   * @param fields The first float of the field, laid out like Blitz++ stores an Array<TinyVector<float, 3>, 3>
+   * @param sizeX The size of the field along x (nx - 2)
+   * @param sizeY The size of the field along y (ny - 2)
+   * @param sizeZ The size of the field along z (nz - 2)
+   * @param pixelSize The distance between points (mm)
+   */
+  static void deriveField(const double *values, int nx, int ny, int nz, double maxVoltage,
+                          float *fields, int sizeX, int sizeY, int sizeZ, double pixelSize);
+
+  /** @brief The size of the mapped file
+   *
+   * @return The size of the file (bytes)
+   */
+  size_t size() const;
+};
@@ -0,0 +1,220 @@
+#include "SharedGeometryStore.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Electrode.h"
+#include "FieldCache.h"
+#include "PhysicalConstants.h"
+#include "SubConfig.h"
+
+namespace {
+
+// The state flag lives in the header page, after the FieldCacheHeader
+inline std::atomic<uint32_t>& segmentState(char *data) {
+  return *reinterpret_cast<std::atomic<uint32_t>*>(data + SharedGeometryStore::STATE_OFFSET);
+}
+
+}
+
+SharedGeometryStore::SharedGeometryStore(std::shared_ptr<AcceleratorConfig> config,
+                                         std::shared_ptr<FieldCache> layout)
+    : config_(config),
+      layout_(layout) {
+  static_assert(sizeof(FieldCacheHeader) <= STATE_OFFSET, "State flag would overwrite the header");
+
+  if (!config_->shmName().empty()) {
+    name_ = config_->shmName();
+  } else {
+    std::stringstream name;
+    name << "/flye_";
+    for (char c : config_->PAname()) {
+      name << (std::isalnum(c) ? c : '_');
+    }
+    name << "_" << config_->nElectrodes() << "_" << config_->x() << "x" << config_->y() << "x" << config_->z()
+         << "_" << std::hex << layout_->checksum();
+    name_ = name.str();
+  }
+}
+
+SharedGeometryStore::~SharedGeometryStore() {
+  unmap();
+  if (lockFd_ >= 0) close(lockFd_);
+}
+
+size_t SharedGeometryStore::segmentSize() const {
+  return FieldCache::ALIGNMENT
+      + sizeof(float) * Physics::N_DIMENSIONS * config_->nElectrodes()
+          * static_cast<size_t>(config_->x()) * config_->y() * config_->z();
+}
+
+void SharedGeometryStore::attachElectrodes(std::vector<std::shared_ptr<Electrode> > &electrodes) {
+  size_t nPoints = static_cast<size_t>(config_->x()) * config_->y() * config_->z();
+  blitz::TinyVector<float, 3> *fields = reinterpret_cast<blitz::TinyVector<float, 3>*>(data_ + FieldCache::ALIGNMENT);
+
+  for (unsigned int e = 0; e < electrodes.size(); ++e) {
+    electrodes[e]->attach(fields + e * nPoints, config_->x(), config_->y(), config_->z());
+  }
+}
+
+void SharedGeometryStore::unmap() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+bool SharedGeometryStore::creatorDied(int fd) {
+  if (flock(fd, LOCK_SH | LOCK_NB) != 0) return false;  // Still held
+
+  flock(fd, LOCK_UN);
+  return true;
+}
+
+void SharedGeometryStore::removeStale(int fd) {
+  std::cout << "The process building shared geometry " << name_ << " died; removing it" << std::endl;
+
+  // Another process may have removed it already and made a new one under the same name, which must be left alone
+  struct stat stale, current;
+  int currentFd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (currentFd < 0) return;
+
+  if (fstat(fd, &stale) == 0 && fstat(currentFd, &current) == 0 && stale.st_ino == current.st_ino) {
+    remove(name_);
+  }
+  close(currentFd);
+}
+
+bool SharedGeometryStore::attach(std::vector<std::shared_ptr<Electrode> > &electrodes) {
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) return false;
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(ATTACH_TIMEOUT);
+  bool announced = false;
+  int unlockedPolls = 0;  // The creator locks the segment just after creating it, so one unlocked poll could be a race
+
+  // The creator sizes the segment straight after creating it, but we might get here first
+  struct stat info;
+  info.st_size = 0;
+  while (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) < segmentSize()
+      && std::chrono::steady_clock::now() < deadline) {
+    unlockedPolls = (creatorDied(fd)) ? unlockedPolls + 1 : 0;
+    if (unlockedPolls >= 2) break;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  if (static_cast<size_t>(info.st_size) < segmentSize()) {
+    if (unlockedPolls >= 2) removeStale(fd);
+    close(fd);
+    return false;
+  }
+
+  void *mapping = mmap(nullptr, segmentSize(), PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  data_ = static_cast<char*>(mapping);
+  size_ = segmentSize();
+
+  uint32_t state;
+  while ((state = segmentState(data_).load(std::memory_order_acquire)) == BUILDING
+      && std::chrono::steady_clock::now() < deadline) {
+    // The creator only lets go of the lock after publishing, so an unlocked segment that's still building is orphaned
+    unlockedPolls = (creatorDied(fd)) ? unlockedPolls + 1 : 0;
+    if (unlockedPolls >= 2 && segmentState(data_).load(std::memory_order_acquire) == BUILDING) {
+      removeStale(fd);
+      close(fd);
+      unmap();
+      return false;
+    }
+
+    if (!announced) {
+      std::cout << "Waiting for another process to publish " << name_ << "..." << std::endl;
+      announced = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  close(fd);
+
+  if (state != READY || !layout_->matches(*reinterpret_cast<const FieldCacheHeader*>(data_))) {
+    std::cout << "Shared geometry " << name_ << " is unusable; importing privately" << std::endl;
+    unmap();
+    return false;
+  }
+
+  attachElectrodes(electrodes);
+  return true;
+}
+
+bool SharedGeometryStore::create(std::vector<std::shared_ptr<Electrode> > &electrodes) {
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) return false;
+
+  flock(fd, LOCK_EX);  // Held until publish() or abandon(), or until this process dies
+
+  if (ftruncate(fd, segmentSize()) != 0) {  // Zero-filled, so the state starts as BUILDING
+    std::cout << "Error sizing shared memory segment: " << name_ << std::endl;
+    shm_unlink(name_.c_str());
+    close(fd);
+    return false;
+  }
+
+  void *mapping = mmap(nullptr, segmentSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (mapping == MAP_FAILED) {
+    std::cout << "Error mapping shared memory segment: " << name_ << std::endl;
+    shm_unlink(name_.c_str());
+    close(fd);
+    return false;
+  }
+
+  lockFd_ = fd;
+
+  data_ = static_cast<char*>(mapping);
+  size_ = segmentSize();
+
+  layout_->makeHeader(*reinterpret_cast<FieldCacheHeader*>(data_));
+  attachElectrodes(electrodes);
+
+  return true;
+}
+
+void SharedGeometryStore::publish() {
+  segmentState(data_).store(READY, std::memory_order_release);
+  mprotect(data_, size_, PROT_READ);  // Nobody should be writing to it now
+
+  close(lockFd_);  // Releases the lock; attaching processes see READY first
+  lockFd_ = -1;
+
+  std::cout << "Published shared geometry " << name_ << std::endl;
+}
+
+void SharedGeometryStore::abandon() {
+  segmentState(data_).store(FAILED, std::memory_order_release);
+  remove(name_);
+
+  close(lockFd_);
+  lockFd_ = -1;
+}
+
+const std::string& SharedGeometryStore::name() const {
+  return name_;
+}
+
+bool SharedGeometryStore::remove(const std::string &name) {
+  return shm_unlink(name.c_str()) == 0;
+}
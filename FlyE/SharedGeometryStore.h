@@ -0,0 +1,128 @@
+/**@file SharedGeometryStore.h
+ * @brief This file contains the SharedGeometryStore class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AcceleratorConfig;
+class Electrode;
+class FieldCache;
+
+/** @brief Shares the imported electrode fields between processes with POSIX shared memory
+ *
+ * The first process to import a geometry creates a named shared memory segment, imports the fields straight into it and
+ * then publishes it. Every later process on the node attaches to the segment read-only, so the fields are only held in
+ * memory (and only imported) once however many processes are running.
+ *
+ * The segment has the same layout as a FieldCache file, plus a state flag in the header page that tells attaching
+ * processes when the fields are ready. Its name includes the source checksum, so regenerating the fields gives a new segment.
+ * The creating process holds an exclusive flock() on the segment until it publishes (or abandons) it, so if it dies part way
+ * through, the lock is released with it and the next process to attach finds the segment BUILDING but unlocked. It then
+ * removes the segment and imports it again, rather than waiting for ATTACH_TIMEOUT.
+ * Segments outlive the processes that use them (that's the point); they can be removed with remove() or by deleting them from /dev/shm.
+ *
+ * @see FieldCache
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class SharedGeometryStore {
+ protected:
+  std::shared_ptr<AcceleratorConfig> config_; //!< The configuration of the geometry being shared
+  std::shared_ptr<FieldCache> layout_; //!< Describes the layout (and header) of the segment
+  std::string name_; //!< The name of the shared memory segment
+  char *data_ = nullptr; //!< The start of the mapped segment
+  size_t size_ = 0; //!< The size of the mapped segment (bytes)
+  int lockFd_ = -1; //!< The segment, held open (and locked) by the process creating it until it's published
+
+  /** @brief The size of the segment needed for the configured geometry
+   *
+   * @return The size of the segment (bytes)
+   */
+  size_t segmentSize() const;
+
+  /** @brief Points the Electrodes at the fields in the mapped segment
+   *
+   * @param electrodes The Electrodes to attach, in order
+   */
+  void attachElectrodes(std::vector<std::shared_ptr<Electrode> > &electrodes);
+
+  /** @brief Unmaps the segment, if it's mapped */
+  void unmap();
+
+  /** @brief Whether the process creating a segment has died
+   *
+   * @param fd The open segment
+   * @return true if nobody holds the creator's lock on it
+   */
+  static bool creatorDied(int fd);
+
+  /** @brief Removes a segment left behind by a dead creator, unless it's already been replaced by a new one
+   *
+   * @param fd The open (stale) segment
+   */
+  void removeStale(int fd);
+
+ public:
+  static constexpr size_t STATE_OFFSET = 1024; //!< Offset of the state flag in the header page (bytes)
+  static constexpr int ATTACH_TIMEOUT = 3600; //!< How long to wait for another process to publish a segment (s)
+
+  /** @brief States of a segment */
+  enum State {
+    BUILDING = 0, //!< The creating process is still importing the fields
+    READY = 1, //!< The fields are ready to use
+    FAILED = 2 //!< The creating process gave up
+  };
+
+  /** @brief Constructs a store for the given geometry
+   *
+   * @param config The configuration of the geometry
+   * @param layout A FieldCache for the same geometry, which describes the segment's layout
+   */
+  SharedGeometryStore(std::shared_ptr<AcceleratorConfig> config, std::shared_ptr<FieldCache> layout);
+
+  ~SharedGeometryStore(); //!< Unmaps the segment (but leaves it in place for other processes)
+
+  /** @brief Attaches to a segment published by another process
+   *
+   * Waits for the segment to become ready if another process is still building it. If that process has died, the segment
+   * is removed, so that create() can make a new one.
+   *
+   * @param electrodes The (empty) Electrodes to attach, in order
+   * @return true if the Electrodes are now read-only views onto the shared fields
+   */
+  bool attach(std::vector<std::shared_ptr<Electrode> > &electrodes);
+
+  /** @brief Creates a new segment for this process to import into
+   *
+   * @param electrodes The (empty) Electrodes, which become writable views onto the new segment
+   * @return true if the segment was created, false if it already exists or couldn't be created
+   */
+  bool create(std::vector<std::shared_ptr<Electrode> > &electrodes);
+
+  /** @brief Marks a segment created by this process as ready for other processes */
+  void publish();
+
+  /** @brief Marks a segment created by this process as failed and removes it */
+  void abandon();
+
+  /** @brief The name of the shared memory segment
+   *
+   * @return The configured name, or one made from the PA name and the source checksum
+   */
+  const std::string& name() const;
+
+  /** @brief Removes a shared memory segment
+   *
+   * Processes that are already attached keep their mapping.
+   *
+   * @param name The name of the segment
+   * @return true if the segment was removed
+   */
+  static bool remove(const std::string &name);
+};
@@ -1,5 +1,8 @@
 #include "Simulator.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <numeric>
 
 #include "PhysicalConstants.h"
@@ -28,9 +31,11 @@ Simulator::Simulator(AcceleratorGeometry &geometry,
                      std::shared_ptr<StorageConfig> storageConfig)
     : geometry_(geometry),
       particles_(particles),
+      store_(particles_),
       simulationConfig_(simulationConfig),
       acceleratorConfig_(geometry.getAcceleratorConfig()),
-      storageConfig_(storageConfig) {
+      storageConfig_(storageConfig),
+      integrator_(Integrator::named(simulationConfig->integrator())) {
 
   statsStorage_.nParticles = static_cast<int>(particles_.size());
 
@@ -65,110 +70,388 @@ Simulator::Simulator(AcceleratorGeometry &geometry,
         simulationConfig_->timeStep());  // Time step
   }
 
+  geometry_.prefetchElectrodes(voltageScheme_->upcomingElectrodes(acceleratorConfig_->prefetchSections()));
   geometry_.applyElectrodeVoltages(voltageScheme_->getInitialVoltages());
   field_ = geometry_.makeSmartField();
+
+  std::vector<std::vector<float> > modePatterns = voltageScheme_->modePatterns();
+
+  // Only a trap is made of two patterns that can be tabulated by phase
+  bool tabulated = simulationConfig_->phaseTable() > 0 && modePatterns.size() == 2;
+  if (simulationConfig_->phaseTable() > 0 && !tabulated) {
+    std::cout << "The phase table only works with the trap scheme; not using it" << std::endl;
+  }
+
+  // A dense sweep costs about one lookup per grid point, but only when the voltages change
+  size_t nPoints = static_cast<size_t>(acceleratorConfig_->x()) * acceleratorConfig_->y() * acceleratorConfig_->z();
+  denseField_ = simulationConfig_->interpolateField() || simulationConfig_->fieldEvaluation() == "dense"
+      || simulationConfig_->fieldWindow() > 0 || tabulated || (simulationConfig_->fieldEvaluation() == "auto" && particles_.size() * LAZY_LOOKUPS >= nPoints);
+
+  std::cout << "Evaluating the field " << ((denseField_) ? "densely" : "lazily") << " (" << particles_.size()
+            << " particles, " << nPoints << " grid points)" << std::endl;
+
+  if (tabulated) {
+    // Set up with the patterns below
+  } else if (simulationConfig_->fieldWindow() > 0) {
+    field_.useWindow(simulationConfig_->fieldWindow());
+    std::cout << "Keeping the field in a window " << simulationConfig_->fieldWindow() << " points around the particles"
+              << std::endl;
+  } else if (denseField_) {
+    field_.keepGradients();
+  }
+
+  if (!modePatterns.empty()) {
+    if (tabulated) {
+      geometry_.usePhaseTable(field_, modePatterns, simulationConfig_->phaseTable());
+    } else {
+      geometry_.useVoltageModes(field_, modePatterns);
+    }
+
+    // The initial voltages were applied directly, so the blend (or phase) has to catch up with them
+    field_.blendModes(voltageScheme_->modeCoefficients(0));
+  }
 }
 
 Simulator::~Simulator() {
   delete voltageScheme_;
 }
 
-void Simulator::run() {
-  int nTimeSteps = simulationConfig_->duration()
-      / simulationConfig_->timeStep();
+GridBox Simulator::particleBox(float lowest, float highest) {
+  float lowX = std::numeric_limits<float>::max(), lowY = lowX, lowZ = lowX;
+  float highX = std::numeric_limits<float>::lowest(), highY = highX, highZ = highX;
+
+  const float *x = store_.position(0), *y = store_.position(1), *z = store_.position(2);
+  const float *vx = store_.velocity(0), *vy = store_.velocity(1), *vz = store_.velocity(2);
+  const float stepLength = simulationConfig_->timeStep() * Physics::MM_M_FACTOR;  // Grid spacings per m/s
+  const long nParticles = store_.nLive();
+
+#pragma omp parallel for reduction(min:lowX, lowY, lowZ) reduction(max:highX, highY, highZ)
+  for (long i = 0; i < nParticles; ++i) {
+    if (!store_.isFlying(i)) continue;
+
+    // lowest <= 0 <= highest, so the particle itself is always in the sweep
+    const float dx = vx[i] * stepLength, dy = vy[i] * stepLength, dz = vz[i] * stepLength;
+    lowX = std::min(lowX, x[i] + std::min(lowest * dx, highest * dx));
+    lowY = std::min(lowY, y[i] + std::min(lowest * dy, highest * dy));
+    lowZ = std::min(lowZ, z[i] + std::min(lowest * dz, highest * dz));
+    highX = std::max(highX, x[i] + std::max(lowest * dx, highest * dx));
+    highY = std::max(highY, y[i] + std::max(lowest * dy, highest * dy));
+    highZ = std::max(highZ, z[i] + std::max(lowest * dz, highest * dz));
+  }
+
+  if (lowZ > highZ) return GridBox();
+
+  return GridBox(std::floor(lowX), std::floor(lowY), std::floor(lowZ), std::ceil(highX), std::ceil(highY),
+                 std::ceil(highZ));
+}
+
+template<Simulator::FieldLookup LOOKUP>
+ParticleStore::Status Simulator::checkedAccelerationAt(size_t i, const StepInvariants &invariants, float a[3]) {
+  const int x = round(store_.position(0)[i]), y = round(store_.position(1)[i]), z = round(store_.position(2)[i]);
+
+  // As at the start of a step, but a drift can overshoot the end of the grid, where there's nothing to hit
+  if (x <= 1 || y <= 1 || z <= 1 || x >= invariants.x - 1 || y >= invariants.y - 1
+      || (z < invariants.z && invariants.locator->existsAt(x, y, z))) {
+    return ParticleStore::COLLIDED;
+  }
+
+  if (accelerationAt<LOOKUP>(i, invariants, a) >= store_.ionisationLim(i)) return ParticleStore::IONISED;
+
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+    store_.acceleration(d)[i] = a[d];  // The last one looked up, for the pending kick
+  }
+  return ParticleStore::FLYING;
+}
+
+template<Simulator::FieldLookup LOOKUP>
+void Simulator::finishKicks(const StepInvariants &invariants) {
+  const long nParticles = store_.nLive();
+
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < nParticles; ++i) {
+    if (!store_.isFlying(i) || store_.pendingKick(i) == 0.0) continue;
+
+    float a[3];
+    accelerationAt<LOOKUP>(i, invariants, a);
+    store_.kick(i, a, store_.pendingKick(i));
+    store_.pendingKick(i) = 0.0;
+  }
+}
+
+template<Simulator::FieldLookup LOOKUP>
+float Simulator::accelerationAt(size_t i, const StepInvariants &invariants, float a[3]) {
+  // One point in from the edges, so the lazy gradients don't look outside the grid
+  const float x = std::min(std::max(store_.position(0)[i], 1.0f), invariants.x - 2.0f);
+  const float y = std::min(std::max(store_.position(1)[i], 1.0f), invariants.y - 2.0f);
+  const float z = std::min(std::max(store_.position(2)[i], 1.0f), invariants.z - 2.0f);
+
+  float mag;
+  blitz::TinyVector<float, 3> gradient;
+
+  if (LOOKUP == FieldLookup::INTERPOLATED) {
+    field_.sample(x, y, z, mag, gradient);
+  } else {
+    tuple3Dint rndLoc = std::make_tuple(static_cast<int>(round(x)), static_cast<int>(round(y)),
+                                        static_cast<int>(round(z)));
+    if (LOOKUP == FieldLookup::DENSE) {
+      field_.nodeAt(std::get<0>(rndLoc), std::get<1>(rndLoc), std::get<2>(rndLoc), mag, gradient);
+    } else {
+      mag = field_.magnitudeAt(rndLoc);
+      gradient = blitz::TinyVector<float, 3>(field_.gradientXat(rndLoc), field_.gradientYat(rndLoc),
+                                             field_.gradientZat(rndLoc));
+    }
+  }
+
+  for (int d = 0; d < Physics::N_DIMENSIONS; ++d) {
+    a[d] = gradient[d] * store_.coefficient(i);
+  }
 
+  return mag;
+}
+
+template<Simulator::FieldLookup LOOKUP, Integrator::Method METHOD>
+ParticleStore::Status Simulator::advance(size_t i, const float a0[3], int nSubsteps, const StepInvariants &invariants) {
+  const float h = invariants.timeStep / nSubsteps;
+  float a[3] = { a0[0], a0[1], a0[2] };
+  ParticleStore::Status status;
+
+  if (METHOD == Integrator::EULER) {
+    for (int s = 0; s < nSubsteps; ++s) {
+      if (s > 0 && (status = checkedAccelerationAt<LOOKUP>(i, invariants, a)) != ParticleStore::FLYING) return status;
+      store_.eulerStep(i, a, h);
+    }
+    return ParticleStore::FLYING;
+  }
+
+  // The kick left over from the last step is at this position too, so it goes in with the first one
+  store_.kick(i, a, store_.pendingKick(i) + integrator_.kicks[0] * h);
+
+  for (int s = 0; s < nSubsteps; ++s) {
+    for (int k = 0; k < integrator_.nDrifts; ++k) {
+      store_.drift(i, integrator_.drifts[k] * h);
+
+      const bool last = (k == integrator_.nDrifts - 1);
+      if (last && s == nSubsteps - 1) break;  // The last kick waits for the next step's lookup (and checks)
+
+      // The drifts go outside the step (Forest-Ruth's first overshoots, and its second goes backwards), so check each one
+      if ((status = checkedAccelerationAt<LOOKUP>(i, invariants, a)) != ParticleStore::FLYING) {
+        store_.pendingKick(i) = 0.0;  // Every kick so far has been applied
+        return status;
+      }
+      store_.kick(i, a, (integrator_.kicks[k + 1] + ((last) ? integrator_.kicks[0] : 0)) * h);
+    }
+  }
+
+  store_.pendingKick(i) = integrator_.kicks[integrator_.nDrifts] * h;
+  return ParticleStore::FLYING;
+}
+
+template<Simulator::FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS, bool STORE_TRAJECTORIES,
+    Integrator::Method METHOD>
+void Simulator::step(int t, const StepInvariants &invariants, SimulationNumbers &counts) {
   int nCollided = 0;
   int nIonised = 0;
   int nSucceeded = 0;
   int nNeutralised = 0;
 
-  ElectrodeLocator locator = geometry_.electrodeLocations();
-
-  std::cout << "Running simulation..." << std::endl;
+  // Euler without sub-steps pushes every particle at once, after they've all been accelerated
+  const bool stepEach = METHOD != Integrator::EULER || invariants.substepGradient > 0;
 
-  ez::ezETAProgressBar timeBar(nTimeSteps);
-  timeBar.start();
+  const long nParticles = store_.nLive();
+  const float *x = store_.position(0), *y = store_.position(1), *z = store_.position(2);
+  float *ax = store_.acceleration(0), *ay = store_.acceleration(1), *az = store_.acceleration(2);
 
-  for (int t = 0; t < nTimeSteps; ++t, ++timeBar) {
 // Particularly good parallelisation
 #pragma omp parallel for schedule( guided, 3 ) reduction( +:nCollided, nIonised, nSucceeded, nNeutralised )
-    for (auto particle = particles_.begin(); particle < particles_.end();
-        ++particle) {
-      if (particle->isDead() || particle->succeeded()) {
-        continue;  // Check to see if the particle is alive
+  for (long i = 0; i < nParticles; ++i) {
+    if (!store_.isFlying(i)) {
+      continue;  // Check to see if the particle is alive
+    }
+
+    tuple3Dint rndLoc = std::make_tuple(static_cast<int>(round(x[i])), static_cast<int>(round(y[i])),
+                                        static_cast<int>(round(z[i])));
+
+    if ((std::get<0>(rndLoc) <= 1 || std::get<1>(rndLoc) <= 1 || std::get<2>(rndLoc) <= 1)
+        || (std::get<0>(rndLoc) >= invariants.x - 1 || std::get<1>(rndLoc) >= invariants.y - 1)
+        || invariants.locator->existsAt(rndLoc)) {
+      store_.collide(i);
+
+      if (!STORE_COLLISIONS) {
+        store_.particle(i).forget();
       }
 
-      tuple3Dint rndLoc = particle->getIntLoc();
+      ++nCollided;
+      continue;
+    }
 
-      if ((std::get<0>(rndLoc) <= 1 || std::get<1>(rndLoc) <= 1 || std::get<2>(rndLoc) <= 1)
-          || (std::get<0>(rndLoc) >= acceleratorConfig_->x() - 1
-              || std::get<1>(rndLoc) >= acceleratorConfig_->y() - 1)
-          || locator.existsAt(rndLoc)) {
-        particle->collide();
+    float mag;
+    blitz::TinyVector<float, 3> gradient;  // Only used when evaluating densely
 
-        if (!storageConfig_->storeCollisions()) {
-          particle->forget();
-        }
+    if (LOOKUP == FieldLookup::INTERPOLATED) {
+      field_.sample(x[i], y[i], z[i], mag, gradient);
+    } else if (LOOKUP == FieldLookup::DENSE) {
+      field_.nodeAt(std::get<0>(rndLoc), std::get<1>(rndLoc), std::get<2>(rndLoc), mag, gradient);
+    } else {
+      mag = field_.magnitudeAt(rndLoc);
+    }
 
-        ++nCollided;
-        continue;
+    if (mag >= store_.ionisationLim(i)) {
+      store_.ionise(i);
+      ++nIonised;
+      continue;
+    }  // Ionise if field too strong
+
+    if (INGLIS_TELLER && mag >= store_.ITlim(i) && store_.neutralise(i, t)) {
+      ++nNeutralised;
+    }  // Neutralise is field is past the Inglis-Teller limit
+
+    if (std::get<2>(rndLoc) >= invariants.z) {
+      store_.succeed(i);
+      ++nSucceeded;
+      continue;
+    }  // If particle makes it to the far end
+
+    store_.checkMaxField(i, mag); // Storing max field encountered
+
+    float dEx = (LOOKUP != FieldLookup::LAZY) ? gradient[0] : field_.gradientXat(rndLoc);  // Field gradients
+    float dEy = (LOOKUP != FieldLookup::LAZY) ? gradient[1] : field_.gradientYat(rndLoc);
+    float dEz = (LOOKUP != FieldLookup::LAZY) ? gradient[2] : field_.gradientZat(rndLoc);
+
+    ax[i] = dEx * store_.coefficient(i);  // Accelerations
+    ay[i] = dEy * store_.coefficient(i);
+    az[i] = dEz * store_.coefficient(i);
+
+    if (stepEach) {
+      int nSubsteps = 1;
+      float steepness = std::sqrt(dEx * dEx + dEy * dEy + dEz * dEz);
+      if (invariants.substepGradient > 0 && steepness > invariants.substepGradient) {
+        nSubsteps = std::min(invariants.maxSubsteps, static_cast<int>(std::ceil(steepness / invariants.substepGradient)));
       }
 
-      float mag = field_.magnitudeAt(rndLoc);
+      const float a[3] = { ax[i], ay[i], az[i] };
+      ParticleStore::Status fate = advance<LOOKUP, METHOD>(i, a, nSubsteps, invariants);
 
-      if (mag >= particle->ionisationLim()) {
-        particle->ionise();
+      if (fate == ParticleStore::COLLIDED) {  // Hit something part way through the step
+        store_.collide(i);
+        if (!STORE_COLLISIONS) {
+          store_.particle(i).forget();
+        }
+        ++nCollided;
+      } else if (fate == ParticleStore::IONISED) {
+        store_.ionise(i);
         ++nIonised;
-        continue;
-      }  // Ionise if field too strong
-
-      if (simulationConfig_->inglisTeller() && mag >= particle->ITlim() && !particle->isNeutralised()) {
-        particle->neutralise(t);
-        ++nNeutralised;
-      }  // Neutralise is field is past the Inglis-Teller limit
-
-      if (std::get<2>(rndLoc) >= acceleratorConfig_->z()) {
-        particle->succeed();
-        ++nSucceeded;
-        continue;
-      }  // If particle makes it to the far end
-
-      particle->checkMaxField(mag); // Storing max field encountered
-
-      float dEx = field_.gradientXat(rndLoc);  // Field gradients
-      float dEy = field_.gradientYat(rndLoc);
-      float dEz = field_.gradientZat(rndLoc);
-
-      float ax = dEx * particle->mu() / Physics::mH;  // Accelerations
-      float ay = dEy * particle->mu() / Physics::mH;
-      float az = dEz * particle->mu() / Physics::mH;
-
-      particle->setVel(
-          particle->getVelDim<0>() + ax * simulationConfig_->timeStep(),  // Accelerate it
-          particle->getVelDim<1>() + ay * simulationConfig_->timeStep(),
-          particle->getVelDim<2>() + az * simulationConfig_->timeStep());
-
-      particle->setLoc(
-          particle->getLocDim<0>()
-              + (particle->getVelDim<0>() * simulationConfig_->timeStep()
-                  + 0.5 * ax * pow(simulationConfig_->timeStep(), 2))
-                  * Physics::MM_M_FACTOR,  // Move it
-          particle->getLocDim<1>()
-              + (particle->getVelDim<1>() * simulationConfig_->timeStep()
-                  + 0.5 * ay * pow(simulationConfig_->timeStep(), 2))
-                  * Physics::MM_M_FACTOR,
-          particle->getLocDim<2>()
-              + (particle->getVelDim<2>() * simulationConfig_->timeStep()
-                  + 0.5 * az * pow(simulationConfig_->timeStep(), 2))
-                  * Physics::MM_M_FACTOR);
-
-      if (storageConfig_->storeTrajectories())
-        particle->memorise();  // Commit to memory
+      }
+    }
+  }
+
+  if (!stepEach) store_.push(invariants.timeStep);  // Accelerate and move every particle that's still flying
+
+  if (STORE_TRAJECTORIES) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < nParticles; ++i) {
+      if (store_.isFlying(i)) store_.particle(i).memorise();  // Commit to memory
+    }
+  }
+
+  counts.nCollided += nCollided;
+  counts.nIonised += nIonised;
+  counts.nSucceeded += nSucceeded;
+  counts.nNeutralised += nNeutralised;
+}
+
+Simulator::StepKernel Simulator::chooseStep() const {
+  if (simulationConfig_->interpolateField()) return chooseStep<FieldLookup::INTERPOLATED>();
+  if (denseField_) return chooseStep<FieldLookup::DENSE>();
+  return chooseStep<FieldLookup::LAZY>();
+}
+
+template<Simulator::FieldLookup LOOKUP>
+Simulator::StepKernel Simulator::chooseStep() const {
+  if (simulationConfig_->inglisTeller()) return chooseStep<LOOKUP, true>();
+  return chooseStep<LOOKUP, false>();
+}
+
+template<Simulator::FieldLookup LOOKUP, bool INGLIS_TELLER>
+Simulator::StepKernel Simulator::chooseStep() const {
+  if (storageConfig_->storeCollisions()) return chooseStep<LOOKUP, INGLIS_TELLER, true>();
+  return chooseStep<LOOKUP, INGLIS_TELLER, false>();
+}
+
+template<Simulator::FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS>
+Simulator::StepKernel Simulator::chooseStep() const {
+  if (storageConfig_->storeTrajectories()) return chooseStep<LOOKUP, INGLIS_TELLER, STORE_COLLISIONS, true>();
+  return chooseStep<LOOKUP, INGLIS_TELLER, STORE_COLLISIONS, false>();
+}
+
+template<Simulator::FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS, bool STORE_TRAJECTORIES>
+Simulator::StepKernel Simulator::chooseStep() const {
+  switch (integrator_.method) {
+    case Integrator::LEAPFROG:
+      return &Simulator::step<LOOKUP, INGLIS_TELLER, STORE_COLLISIONS, STORE_TRAJECTORIES, Integrator::LEAPFROG>;
+    case Integrator::FOREST_RUTH:
+      return &Simulator::step<LOOKUP, INGLIS_TELLER, STORE_COLLISIONS, STORE_TRAJECTORIES, Integrator::FOREST_RUTH>;
+    default:
+      return &Simulator::step<LOOKUP, INGLIS_TELLER, STORE_COLLISIONS, STORE_TRAJECTORIES, Integrator::EULER>;
+  }
+}
+
+void Simulator::run() {
+  int nTimeSteps = simulationConfig_->duration()
+      / simulationConfig_->timeStep();
+
+  SimulationNumbers counts = statsStorage_;
+  counts.nCollided = counts.nIonised = counts.nSucceeded = counts.nNeutralised = 0;
+
+  ElectrodeLocator locator = geometry_.electrodeLocations();
+
+  const int compactionInterval = simulationConfig_->compactionInterval();
+  const int sortInterval = simulationConfig_->sortInterval();
+  const long nFlying = store_.nLive();  // Every particle in the store is flying to begin with
+
+  const StepInvariants invariants = { simulationConfig_->timeStep(), acceleratorConfig_->x(), acceleratorConfig_->y(),
+      acceleratorConfig_->z(), simulationConfig_->substepGradient(), simulationConfig_->maxSubsteps(), &locator };
+  const StepKernel step = chooseStep();  // Every option that the loop would otherwise check is baked in
+
+  // When the field is looked up between drifts, it has to be refreshed wherever they can take the particles
+  float lowestReach = 0.0, highestReach = 0.0;
+  if (integrator_.symplectic() || invariants.substepGradient > 0) integrator_.reach(lowestReach, highestReach);
+
+  std::cout << "Running simulation..." << std::endl;
+
+  ez::ezETAProgressBar timeBar(nTimeSteps);
+  timeBar.start();
+
+  for (int t = 0; t < nTimeSteps; ++t, ++timeBar) {
+    if (compactionInterval > 0 && t > 0 && t % compactionInterval == 0) {
+      store_.compact();
     }
+
+    if (sortInterval > 0 && t > 0 && t % sortInterval == 0) {
+      store_.sortByCell(invariants.x, invariants.y, invariants.z);
+    }
+
+    // Once nothing is flying, the rest of the voltage scheme can't affect anything
+    if (counts.nCollided + counts.nIonised + counts.nSucceeded >= nFlying) {
+      std::cout << "\nNo particles left flying after " << t << " time steps" << std::endl;
+      break;
+    }
+
+    if (denseField_) {  // Only where the particles are (and the points either side, for interpolating)
+      GridBox particles = particleBox(lowestReach, highestReach);
+      if (!particles.empty()) field_.followParticles(particles);
+    }
+
+    (this->*step)(t, invariants, counts);
+
     // Update field
     if (voltageScheme_->isActive(t)) {
       geometry_.applyElectrodeVoltages(voltageScheme_->getVoltages(t+1));
-      field_ = geometry_.makeSmartField();
+      geometry_.prefetchElectrodes(voltageScheme_->upcomingElectrodes(acceleratorConfig_->prefetchSections()));
+      if (field_.usesModes()) {
+        field_.blendModes(voltageScheme_->modeCoefficients(t + 1));
+      } else {
+        geometry_.updateSmartField(field_);
+      }
     }
 
 #ifdef EBUG_FIELDS
@@ -179,10 +462,24 @@ void Simulator::run() {
 #endif
   }
 
-  statsStorage_.nCollided = nCollided;
-  statsStorage_.nSucceeded = nSucceeded;
-  statsStorage_.nIonised = nIonised;
-  statsStorage_.nNeutralised = nNeutralised;
+  if (integrator_.symplectic()) {  // The last step's last kicks are still waiting for a lookup
+    if (denseField_) {
+      GridBox particles = particleBox(0.0, 0.0);
+      if (!particles.empty()) field_.followParticles(particles);
+    }
+
+    if (simulationConfig_->interpolateField()) {
+      finishKicks<FieldLookup::INTERPOLATED>(invariants);
+    } else if (denseField_) {
+      finishKicks<FieldLookup::DENSE>(invariants);
+    } else {
+      finishKicks<FieldLookup::LAZY>(invariants);
+    }
+  }
+
+  store_.syncAll();  // So the Writer sees where everything ended up
+
+  statsStorage_ = counts;
 
   std::cout << std::endl;
 }
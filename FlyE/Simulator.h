@@ -11,6 +11,8 @@
 
 #include "AcceleratorGeometry.h"
 #include "AntiHydrogen.h"
+#include "Integrator.h"
+#include "ParticleStore.h"
 #include "SmartField.h"
 #include "SubConfig.h"
 #include "VoltageScheme.h"
@@ -54,17 +56,124 @@ class Simulator {
  protected:
   AcceleratorGeometry geometry_; //!< The geometry to run the simulation with
   std::vector<AntiHydrogen> particles_; //!< A vector of Particles (or, in this case, AntiHydrogen) to run the simulation with
+  ParticleStore store_; //!< The particles' state as separate arrays, which is what each time step actually updates
 
   std::shared_ptr<SimulationConfig> simulationConfig_; //!< Configuration pertaining to the nature of the simulation
   std::shared_ptr<AcceleratorConfig> acceleratorConfig_; //!< Configuration pertaining to the accelerator
   std::shared_ptr<StorageConfig> storageConfig_; //!< Configuration pertaining to how the data is stored
 
   SmartField field_; //!< A SmartField for accessing the E-Field in the accelerator
+  bool denseField_; //!< Whether the field's magnitude and gradient are swept over the particles' slab (or window), instead of looked up lazily
   VoltageScheme *voltageScheme_; //!< The scheme for applying voltages: exponential, instantaneous or trap
+  Integrator integrator_; //!< How to move the particles through a time step
 
   SimulationNumbers statsStorage_; //!< Storage for basic statistics from the simulation
 
+  /** @brief Finds the grid points that the live particles are between, and will drift between during the next step
+   *
+   * Each particle is swept from where it is along its velocity, from lowest to highest time steps (see
+   * Integrator::reach()), so the field is refreshed wherever the step will look it up. Pass 0 for both to just box the
+   * particles.
+   *
+   * @param lowest How far back to sweep, as a fraction of the time step (0 or less)
+   * @param highest How far forward to sweep, as a fraction of the time step (0 or more)
+   * @return The box from the floor of the lowest coordinates of any particle that's still flying to the ceiling of the
+   * highest (empty if there are none)
+   */
+  GridBox particleBox(float lowest, float highest);
+
+  /** @brief How the field is looked up at each particle */
+  enum class FieldLookup {
+    LAZY, //!< At the nearest grid point, memoised by the SmartField
+    DENSE, //!< At the nearest grid point, from the swept magnitudes and gradients
+    INTERPOLATED //!< Interpolated between the grid points around it
+  };
+
+  /** @brief Everything a time step needs that doesn't change from step to step, read out of the configs once */
+  struct StepInvariants {
+    float timeStep; //!< The time step (s)
+    ///@{ @brief Dimensions of the grid
+    int x, y, z;  ///@}
+    float substepGradient; //!< The field gradient above which a step is split up (0 never to)
+    int maxSubsteps; //!< The most sub-steps in a step
+    ElectrodeLocator *locator; //!< Where the electrodes are, to collide with
+  };
+
+  /** @brief A time step, specialised for a set of options (see step()) */
+  typedef void (Simulator::*StepKernel)(int t, const StepInvariants &invariants, SimulationNumbers &counts);
+
+  /** @brief Looks up the acceleration of a particle where it is now, the same way as at the start of a time step
+   *
+   * The position is clamped to the grid, since it may have drifted a little outside; nothing is checked.
+   *
+   * @param i The slot of the particle
+   * @param invariants The grid's dimensions etc
+   * @param[out] a The acceleration in x, y and z (m/s^2)
+   * @return The magnitude of the field
+   */
+  template<FieldLookup LOOKUP>
+  float accelerationAt(size_t i, const StepInvariants &invariants, float a[3]);
+
+  /** @brief Checks that a particle part way through a time step hasn't hit anything or been ionised, then looks up its
+   * acceleration (see accelerationAt())
+   *
+   * @param i The slot of the particle
+   * @param invariants The grid's dimensions etc
+   * @param[out] a The acceleration in x, y and z (m/s^2), if it's still flying
+   * @return FLYING, COLLIDED or IONISED (the fate isn't passed on to the store)
+   */
+  template<FieldLookup LOOKUP>
+  ParticleStore::Status checkedAccelerationAt(size_t i, const StepInvariants &invariants, float a[3]);
+
+  /** @brief Moves a particle through a time step with the integrator, in equal sub-steps
+   *
+   * Stops part way if the particle hits an electrode or the sides of the grid, or is ionised, between drifts.
+   *
+   * @param i The slot of the particle
+   * @param a The acceleration at the start of the step (m/s^2)
+   * @param nSubsteps The number of sub-steps to split the step into
+   * @param invariants The time step etc
+   * @return FLYING, or the fate that stopped it (which the caller passes on to the store)
+   */
+  template<FieldLookup LOOKUP, Integrator::Method METHOD>
+  ParticleStore::Status advance(size_t i, const float a[3], int nSubsteps, const StepInvariants &invariants);
+
+  /** @brief Applies every flying particle's pending kick (see ParticleStore::pendingKick()) with the acceleration where it
+   * is now, so the final velocities aren't behind
+   *
+   * @param invariants The grid's dimensions etc
+   */
+  template<FieldLookup LOOKUP>
+  void finishKicks(const StepInvariants &invariants);
+
+  /** @brief Moves every live particle through one time step: collides, ionises, neutralises, accelerates and stores them
+   *
+   * Each combination of options is its own instantiation, chosen once by chooseStep(), so the loop over the particles
+   * doesn't branch on (or look up) options that don't change.
+   *
+   * @param t The time step
+   * @param invariants The time step, grid dimensions etc
+   * @param[in,out] counts The numbers of particles that have collided etc, added to
+   */
+  template<FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS, bool STORE_TRAJECTORIES,
+      Integrator::Method METHOD>
+  void step(int t, const StepInvariants &invariants, SimulationNumbers &counts);
+
+  ///@{
+  /** @brief Picks the instantiation of step() for the configured options, one option at a time */
+  StepKernel chooseStep() const;
+  template<FieldLookup LOOKUP>
+  StepKernel chooseStep() const;
+  template<FieldLookup LOOKUP, bool INGLIS_TELLER>
+  StepKernel chooseStep() const;
+  template<FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS>
+  StepKernel chooseStep() const;
+  template<FieldLookup LOOKUP, bool INGLIS_TELLER, bool STORE_COLLISIONS, bool STORE_TRAJECTORIES>
+  StepKernel chooseStep() const;
+  ///@}
+
  public:
+  static constexpr int LAZY_LOOKUPS = 7; //!< Magnitude lookups per particle per time step when evaluating lazily
   /** Construct from a geometry and vector of particles, and appropriate storage structs
    *
    * @param geometry An AcceleratorGeometry instance
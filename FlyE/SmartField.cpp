@@ -5,16 +5,239 @@
 SmartField::SmartField() {
 }
 
-SmartField::SmartField(std::vector<std::shared_ptr<Electrode> > electrodes)
-    : electrodes_(electrodes) {
-  magnitudeMemory_.reserve(electrodes_[0]->numElements());
+SmartField::SmartField(std::vector<std::shared_ptr<Electrode> > electrodes, int x, int y, int z,
+                       std::shared_ptr<const InterleavedBasis> basis)
+    : electrodes_(electrodes),
+      magnitudeMemory_(std::make_shared<MagnitudeCache>(x, y, z)),
+      superposed_(std::make_shared<VectorField>(x, y, z)),
+      voltages_(electrodes.size(), 0.0),
+      basis_(basis),
+      grid_(0, 0, 0, x - 1, y - 1, z - 1),
+      engine_(x, y, z) {
+  rebuild();
+}
+
+void SmartField::rebuild() {
+  for (unsigned int e = 0; e < electrodes_.size(); ++e) {
+    voltages_[e] = electrodes_[e]->getVoltage();
+  }
+
+  if (table_) {
+    // Looked up, not superposed (blendModes() sets the phase)
+  } else if (window_) {  // Superposed as it's placed
+    window_->invalidate();
+  } else if (basis_) {
+    basis_->superpose(voltages_, *superposed_);
+  } else {
+    engine_.superpose(electrodes_, voltages_, *superposed_);
+  }
+
+  magnitudeMemory_->invalidate();
+  if (gradients_) gradients_->invalidate(gradients_->all());
+  nUpdates_ = 0;
+}
+
+void SmartField::updateVoltages(std::vector<std::shared_ptr<Electrode> > electrodes) {
+  electrodes_ = electrodes;
+
+  std::vector<unsigned int> changed;
+  size_t nPoints = 0;
+
+  for (unsigned int e = 0; e < electrodes_.size(); ++e) {
+    if (electrodes_[e]->getVoltage() != voltages_[e]) {
+      changed.push_back(e);
+      nPoints += electrodes_[e]->support().nPoints();
+    }
+  }
+
+  if (changed.empty()) return;
+
+  if (table_ || window_ || nPoints >= grid_.nPoints() || (!basis_ && ++nUpdates_ >= REBUILD_INTERVAL)) {
+    rebuild();
+    return;
+  }
+
+  GridBox changedBox;
+
+  for (unsigned int e : changed) {
+    float newVoltage = electrodes_[e]->getVoltage();
+    if (!basis_) electrodes_[e]->addTo(*superposed_, newVoltage - voltages_[e]);
+    magnitudeMemory_->invalidate(electrodes_[e]->support());
+    changedBox.expand(electrodes_[e]->support());
+    voltages_[e] = newVoltage;
+  }
+
+  // Summed the same way as a rebuild, so it doesn't drift away from one
+  if (basis_) basis_->superpose(voltages_, *superposed_, changedBox);
+
+  if (gradients_) gradients_->invalidate(changedBox);
+}
+
+void SmartField::setModes(std::vector<std::shared_ptr<Electrode> > electrodes,
+                          const std::vector<std::vector<float> > &patterns) {
+  electrodes_ = electrodes;
+  modes_.clear();
+
+  for (auto &pattern : patterns) {
+    auto mode = std::make_shared<VectorField>(grid_.x1 + 1, grid_.y1 + 1, grid_.z1 + 1);
+
+    if (basis_) {
+      basis_->superpose(pattern, *mode);
+    } else {
+      engine_.superpose(electrodes_, pattern, *mode);
+    }
+
+    modes_.push_back(mode);
+  }
+}
+
+bool SmartField::usesModes() const {
+  return !modes_.empty() || table_;
+}
+
+void SmartField::blendModes(const std::vector<float> &coefficients) {
+  coefficients_ = coefficients;
+
+  for (unsigned int e = 0; e < electrodes_.size(); ++e) {  // So that updateVoltages() carries on from here
+    voltages_[e] = electrodes_[e]->getVoltage();
+  }
+
+  magnitudeMemory_->invalidate();
+
+  if (table_) {  // Nothing to blend, just somewhere else to look
+    phase_ = table_->phase(coefficients[0], coefficients[1]);
+    return;
+  }
+
+  if (window_) {  // Blended as it's placed
+    window_->invalidate();
+    return;
+  }
+
+  float *field = reinterpret_cast<float*>(superposed_->data());
+  const long nFloats = 3 * superposed_->numElements();
+
+  std::vector<const float*> modes;
+  for (auto &mode : modes_) {
+    modes.push_back(reinterpret_cast<const float*>(mode->data()));
+  }
+
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < nFloats; ++i) {
+    float sum = 0;
+    for (unsigned int m = 0; m < modes.size(); ++m) {
+      sum += coefficients[m] * modes[m][i];
+    }
+    field[i] = sum;
+  }
+
+  if (gradients_) gradients_->invalidate(gradients_->all());
+}
+
+void SmartField::keepGradients() {
+  if (gradients_) return;
+
+  // Everything starts stale
+  gradients_ = std::make_shared<GradientField>(grid_.x1 + 1, grid_.y1 + 1, grid_.z1 + 1);
+}
+
+void SmartField::useWindow(int margin) {
+  window_ = std::make_shared<FieldWindow>(grid_.x1 + 1, grid_.y1 + 1, grid_.z1 + 1, margin);
+
+  // Nothing is kept for the whole grid any more
+  superposed_.reset();
+  gradients_.reset();
+}
+
+void SmartField::usePhaseTable(std::shared_ptr<PhaseTable> table) {
+  if (!table->ready()) table->build(*modes_[0], *modes_[1]);
+  table_ = table;
+
+  // Nothing is kept for the whole grid any more, not even the modes
+  superposed_.reset();
+  gradients_.reset();
+  window_.reset();
+  modes_.clear();
+}
+
+void SmartField::followParticles(const GridBox &particles) {
+  if (table_) return;
+
+  if (!window_) {
+    gradients_->refresh(*superposed_, particles.z0 - 1, particles.z1 + 1);
+    return;
+  }
+
+  if (window_->covers(particles)) return;
+
+  window_->place(particles);
+  fillWindow();
+  window_->finish();
+}
+
+void SmartField::fillWindow() {
+  const GridBox &tile = window_->tile();
+  if (tile.empty()) return;
+
+  if (!modes_.empty()) {
+    std::vector<const VectorField*> modes;
+    for (auto &mode : modes_) {
+      modes.push_back(mode.get());
+    }
+
+#pragma omp parallel for collapse(2)
+    for (int x = tile.x0; x <= tile.x1; ++x) {
+      for (int y = tile.y0; y <= tile.y1; ++y) {
+        float *row = window_->fieldAt(x, y, tile.z0);
+
+        for (unsigned int m = 0; m < modes.size(); ++m) {
+          const float *mode = reinterpret_cast<const float*>(&(*modes[m])(x, y, tile.z0));
+          for (int i = 0; i < 3 * (tile.z1 - tile.z0 + 1); ++i) {
+            row[i] += coefficients_[m] * mode[i];
+          }
+        }
+      }
+    }
+  } else if (basis_) {
+    basis_->superpose(voltages_, *window_);
+  } else {
+    for (unsigned int e = 0; e < electrodes_.size(); ++e) {
+      if (voltages_[e] == 0.0) continue;
+
+      GridBox overlap = tile.grown(0, electrodes_[e]->support());  // The part of the tile in the support
+      if (overlap.empty()) continue;
+
+#pragma omp parallel for collapse(2)
+      for (int x = overlap.x0; x <= overlap.x1; ++x) {
+        for (int y = overlap.y0; y <= overlap.y1; ++y) {
+          float *row = window_->fieldAt(x, y, overlap.z0);
+
+          for (int z = overlap.z0; z <= overlap.z1; ++z, row += 3) {
+            blitz::TinyVector<float, 3> field = electrodes_[e]->fieldAt(x, y, z);
+            row[0] += voltages_[e] * field[0];
+            row[1] += voltages_[e] * field[1];
+            row[2] += voltages_[e] * field[2];
+          }
+        }
+      }
+    }
+  }
 }
 
 blitz::TinyVector<float, 3> SmartField::at(int x, int y, int z) {
-  blitz::TinyVector<float, 3> point(0.0);
+  // Every Electrode's support is inside the grid, so the field is zero outside it
+  if (!magnitudeMemory_->contains(x, y, z)) return blitz::TinyVector<float, 3>(0.0);
+
+  if (superposed_) return (*superposed_)(x, y, z);
+
+  // Only the window is superposed
+  if (basis_) return basis_->fieldAt(voltages_, x, y, z);
 
-  for (auto &electrode : electrodes_) {
-    point += electrode->getVoltage() * (*electrode)(x, y, z);
+  blitz::TinyVector<float, 3> point(0.0);
+  for (unsigned int e = 0; e < electrodes_.size(); ++e) {
+    if (voltages_[e] != 0.0 && electrodes_[e]->support().contains(x, y, z)) {
+      point += voltages_[e] * electrodes_[e]->fieldAt(x, y, z);
+    }
   }
 
   return point;
@@ -33,25 +256,21 @@ blitz::TinyVector<float, 3> SmartField::at(tuple3Dint r) {
 }
 
 float SmartField::magnitudeAt(int x, int y, int z) {
- tuple3Dint t = std::make_tuple(x, y, z);
+  if (!magnitudeMemory_->contains(x, y, z)) {
+    return VectorField::vectorMagnitude(this->at(x, y, z));
+  }
+
+  float magnitude;
+  if (!magnitudeMemory_->lookup(x, y, z, magnitude)) {
+    magnitude = VectorField::vectorMagnitude(this->at(x, y, z));
+    magnitudeMemory_->store(x, y, z, magnitude);
+  }
 
- if (magnitudeMemory_.count(t) == 0) {
-#pragma omp critical
-   {
-     magnitudeMemory_.insert({{t, VectorField::vectorMagnitude(this->at(x, y, z))}});
-   }
- }
- return magnitudeMemory_[t];
+  return magnitude;
 }
 
 float SmartField::magnitudeAt(tuple3Dint t) {
- if (magnitudeMemory_.count(t) == 0) {
-#pragma omp critical
-   {
-     magnitudeMemory_.insert({{t, VectorField::vectorMagnitude(this->at(t))}});
-   }
- }
- return magnitudeMemory_[t];
+  return magnitudeAt(std::get<0>(t), std::get<1>(t), std::get<2>(t));
 }
 
 float SmartField::gradientXat(int x, int y, int z) {
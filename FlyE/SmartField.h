@@ -1,39 +1,41 @@
 /**@file SmartField.h
- * @brief This file contains the SmartField class and the std::hash<tuple3D> specialization
+ * @brief This file contains the SmartField class
  *
  * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
  */
 #pragma once
 
 #include "Electrode.h"
+#include "FieldWindow.h"
+#include "GradientField.h"
+#include "InterleavedBasis.h"
+#include "MagnitudeCache.h"
+#include "PhaseTable.h"
+#include "SuperpositionEngine.h"
 
-#include <unordered_map>
-#include <tuple>
-
-/** @brief 8-digit primes for hash generation */
-///@{
-#define P1 71234567
-#define P2 25935017
-#define P3 53781811
-///@}
-namespace std {
-/** @brief Template specialisation for std::hash<tuple> */
-template<> struct hash<tuple3Dint> {
-  /** @brief For accessing the hashing algorithm
-   *
-   * @param t A tuple3D (aka std::tuple<int, int, int>) of integer coords
-   * @return A size_t (aka unsigned int) hash code
-   */
-  size_t operator()(const tuple3Dint &t) const {
-    // See Consistent Collision and Self-Collision Handling for Deformable Objects (Heidelburger, 2007)
-    return std::hash<int>()( ((get<0>(t)*P1) ^ (get<1>(t)*P2) ^ (get<2>(t)*P3)) );
-  }
-};
-}
+#include <memory>
 
 /** @brief A clever way to access the superposed fields of electrodes
  *
- * Only sums when accessing a specific point, but remembers magnitude values of points which have been accessed previously.
+ * Keeps the superposed field, and when the voltages change (see updateVoltages()) only adds on the change in each
+ * Electrode's voltage times its field, over its support. With an InterleavedBasis, the changed supports are resummed from
+ * the basis instead, so the field is always exactly what a rebuild would make. Remembers magnitude values of points which have been accessed
+ * previously (in a MagnitudeCache), and only forgets the ones in the changed Electrodes' supports.
+ *
+ * If the voltages are always a combination of a few fixed patterns (see VoltageScheme::modePatterns()), each pattern's field
+ * can be superposed once with setModes(), and then the field is just a blend of those (see blendModes()).
+ *
+ * Alternatively, the magnitude and its gradient can be kept for every point in a GradientField (see keepGradients()). Then
+ * they're recomputed in dense sweeps over the slab that the particles are in (see followParticles()), and looked up at the
+ * nearest point (see nodeAt()) or interpolated between points (see sample()).
+ *
+ * Or, with useWindow(), the field isn't kept for the whole grid at all: it's only superposed in a FieldWindow around the
+ * particles, which follows them down the accelerator (see followParticles()). The lookups are the same.
+ *
+ * If the voltages are always a trap made of two patterns, the magnitude and gradient can instead be looked up in a
+ * PhaseTable (see usePhaseTable()), so blendModes() only has to work out the phase.
+ *
+ * Copies share the superposed field and the remembered magnitudes, so only one of them should be updated.
  *
  * This code is very much not DRY, but I don't want it to inherit from VectorField because that would bring the overhead of
  * the Blitz++ array with it. Maybe I'll change this in future but I think this slightly ugly repetition is faster.
@@ -43,17 +45,141 @@ template<> struct hash<tuple3Dint> {
 class SmartField {
  protected:
   std::vector< std::shared_ptr<Electrode> > electrodes_; //!< All of the electrodes in an AcceleratorGeometry
-  std::unordered_map<tuple3Dint, float> magnitudeMemory_; //!< Remembers magnitudes that have already been accessed
+  std::shared_ptr<MagnitudeCache> magnitudeMemory_; //!< Remembers magnitudes that have already been accessed
+  std::shared_ptr<VectorField> superposed_; //!< The sum of every Electrode's field times its voltage
+  std::vector<float> voltages_; //!< The voltages that the superposed field was made with
+  int nUpdates_ = 0; //!< How many incremental updates there have been since the superposed field was rebuilt
+  std::vector< std::shared_ptr<VectorField> > modes_; //!< The superposed field of each voltage pattern, if there are any
+  std::shared_ptr<GradientField> gradients_; //!< The magnitude and its gradient at each point, if they're being kept
+  std::shared_ptr<const InterleavedBasis> basis_; //!< The basis with the electrodes varying fastest, to superpose with (if there is one)
+  GridBox grid_; //!< The whole grid
+  SuperpositionEngine engine_; //!< Sums the Electrodes over the whole grid, when there's no interleaved basis
+  std::shared_ptr<FieldWindow> window_; //!< The field around the particles, if it's only kept there
+  std::vector<float> coefficients_; //!< How much of each mode the field is made of, if it's a blend of them
+  std::shared_ptr<const PhaseTable> table_; //!< The magnitude and gradient at each phase of a trap, if they're tabulated
+  PhaseTable::Phase phase_; //!< Where to look up the current field in table_
+
+  /** @brief Remakes the superposed field from scratch, and forgets every remembered magnitude */
+  void rebuild();
+
+  /** @brief Superposes the field in the window's tile, from the modes, the interleaved basis or the Electrodes */
+  void fillWindow();
 
  public:
   /** @brief Blank constructor, does nothing */
   SmartField();
 
-  /** @brief Constructs a SmartField from a vector of electrodes
+  static constexpr int REBUILD_INTERVAL = 1000; //!< Incremental updates between rebuilds, so rounding errors don't build up (not needed with an interleaved basis)
+
+  /** @brief Constructs a SmartField from a vector of electrodes, at their current voltages
    *
    * @param electrodes A vector of shared_ptr<Electrode>s
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   * @param basis The same Electrodes' fields interleaved, to do full superpositions with (or nullptr to sum the Electrodes)
    */
-  SmartField(std::vector< std::shared_ptr<Electrode> > electrodes);
+  SmartField(std::vector< std::shared_ptr<Electrode> > electrodes, int x, int y, int z,
+             std::shared_ptr<const InterleavedBasis> basis = nullptr);
+
+  /** @brief Brings the field up to date with the Electrodes' current voltages
+   *
+   * Only the Electrodes whose voltages have changed are added on (or, with an interleaved basis, the box around them is
+   * resummed), unless together they cover more of the grid than the grid itself (or it's time to rebuild), in which case
+   * the field is rebuilt. Not thread safe.
+   *
+   * @param electrodes The Electrodes (which may have been swapped for loaded ones since the last update)
+   */
+  void updateVoltages(std::vector< std::shared_ptr<Electrode> > electrodes);
+
+  /** @brief Superposes the field of each of a few fixed voltage patterns, to be blended by blendModes()
+   *
+   * @param electrodes The Electrodes, all loaded
+   * @param patterns A voltage for each Electrode, for each pattern
+   */
+  void setModes(std::vector< std::shared_ptr<Electrode> > electrodes, const std::vector< std::vector<float> > &patterns);
+
+  /** @brief Whether setModes() has been called (or a PhaseTable is in use), so the field should be updated with blendModes() */
+  bool usesModes() const;
+
+  /** @brief Makes the field a blend of the patterns' fields, and forgets every remembered magnitude
+   *
+   * The Electrodes' voltages should already be the same blend of the patterns. Not thread safe.
+   *
+   * @param coefficients How much of each pattern to use
+   */
+  void blendModes(const std::vector<float> &coefficients);
+
+  /** @brief Starts keeping the magnitude and its gradient at every point, for nodeAt() and sample() */
+  void keepGradients();
+
+  /** @brief Stops keeping the field for the whole grid, and only keeps it (and its gradients) in a window around the particles
+   *
+   * at() and magnitudeAt() still work everywhere, but sum the Electrodes. Replaces keepGradients().
+   *
+   * @param margin How many points to leave around the particles, so the window doesn't have to move every step
+   */
+  void useWindow(int margin);
+
+  /** @brief Looks up the magnitude and gradient in a table of trap phases, instead of keeping the field at all
+   *
+   * If the table wasn't loaded, setModes() must have been called with its two patterns, and it's built from them.
+   * The modes are released afterwards. Replaces keepGradients() and useWindow(); at() and magnitudeAt() still work
+   * everywhere, but sum the Electrodes.
+   *
+   * @param table The table to use
+   */
+  void usePhaseTable(std::shared_ptr<PhaseTable> table);
+
+  /** @brief Brings the magnitudes and gradients up to date where the particles are; keepGradients() or useWindow() must have
+   * been called
+   *
+   * With a PhaseTable, there's nothing to do. With a window, it's moved and refilled if the particles have got too close to its edge (or the field has changed).
+   * Otherwise, the stale gradients in the particles' slab (and the planes either side) are recomputed. Not thread safe.
+   *
+   * @param particles The grid points that the particles are between
+   */
+  void followParticles(const GridBox &particles);
+
+  /** @brief The magnitude of the field and its gradient at a point, which must have been refreshed
+   *
+   * @see GradientField::nodeAt()
+   *
+   * @param x x-coordinate of the point
+   * @param y y-coordinate of the point
+   * @param z z-coordinate of the point
+   * @param[out] magnitude The magnitude of the field at the point
+   * @param[out] gradient The gradient of the magnitude at the point
+   */
+  inline void nodeAt(int x, int y, int z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+    if (table_) {
+      table_->nodeAt(x, y, z, phase_, magnitude, gradient);
+    } else if (window_) {
+      window_->nodeAt(x, y, z, magnitude, gradient);
+    } else {
+      gradients_->nodeAt(x, y, z, magnitude, gradient);
+    }
+  }
+
+  /** @brief Interpolates the magnitude of the field and its gradient at a point, whose cell must have been refreshed
+   *
+   * @see GradientField::sample()
+   *
+   * @param x x-coordinate of the point (mm)
+   * @param y y-coordinate of the point (mm)
+   * @param z z-coordinate of the point (mm)
+   * @param[out] magnitude The magnitude of the field at the point
+   * @param[out] gradient The gradient of the magnitude at the point
+   */
+  inline void sample(float x, float y, float z, float &magnitude, blitz::TinyVector<float, 3> &gradient) const {
+    if (table_) {
+      table_->sample(x, y, z, phase_, magnitude, gradient);
+    } else if (window_) {
+      window_->sample(x, y, z, magnitude, gradient);
+    } else {
+      gradients_->sample(x, y, z, magnitude, gradient);
+    }
+  }
 
   /** @brief The vector of the field at a point
    *
@@ -82,7 +208,7 @@ class SmartField {
    * @param x x-coordinate of the point
    * @param y y-coordinate of the point
    * @param z z-coordinate of the point
-   * @return The magnitude of the field at (x, y, z)
+   * @return The magnitude of the field at (x, y, z) (points outside the grid aren't remembered)
    */
   float magnitudeAt(int x, int y, int z);
 
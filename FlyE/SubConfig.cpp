@@ -3,6 +3,8 @@
 
 #include "SubConfig.h"
 
+#include "PhysicalConstants.h"
+
 SubConfig::~SubConfig() {
 }
 
@@ -19,9 +21,33 @@ void AcceleratorConfig::populate(INIReader &reader) {
   datDirectory_ = reader.Get("accelerator", "dat_directory", "~");
   nElectrodes_ = reader.GetInteger("accelerator", "n_electrodes", 36);
   PAname_ = reader.Get("accelerator", "pa_name", "cylinder");
+  paDirectory_ = reader.Get("accelerator", "pa_directory", "");
+  paPixelSize_ = reader.GetReal("accelerator", "pa_pixel_size", 0.1);
+  solveLaplace_ = reader.GetBoolean("accelerator", "solve_laplace", false);
+  laplaceTolerance_ = reader.GetReal("accelerator", "laplace_tolerance", 1e-6);
   x_ = reader.GetInteger("accelerator", "x", 54) - 2;
   y_ = reader.GetInteger("accelerator", "y", 54) - 2;
   z_ = reader.GetInteger("accelerator", "z", 200) - 2;
+  useFieldCache_ = reader.GetBoolean("accelerator", "use_field_cache", true);
+  fieldCache_ = reader.Get("accelerator", "field_cache", "");
+  sharedMemory_ = reader.GetBoolean("accelerator", "shared_memory", false);
+  shmName_ = reader.Get("accelerator", "shm_name", "");
+  basisStorage_ = reader.Get("accelerator", "basis_storage", "float32");
+  if (basisStorage_ != "float32" && basisStorage_ != "float16" && basisStorage_ != "int16") {
+    try {
+      throw "Invalid value for basis storage!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  supportCutoff_ = (float) reader.GetReal("accelerator", "support_cutoff", 0);
+  rotationalSymmetry_ = reader.GetBoolean("accelerator", "rotational_symmetry", false);
+  periodic_ = reader.GetBoolean("accelerator", "periodic", false);
+  symmetryTolerance_ = (float) reader.GetReal("accelerator", "symmetry_tolerance", 1e-3);
+  lazyLoading_ = reader.GetBoolean("accelerator", "lazy_loading", false);
+  prefetchSections_ = reader.GetInteger("accelerator", "prefetch_sections", 1);
+  interleavedBasis_ = reader.GetBoolean("accelerator", "interleaved_basis", false);
 }
 
 void AcceleratorConfig::printOn(std::ostream &out) {
@@ -30,8 +56,19 @@ void AcceleratorConfig::printOn(std::ostream &out) {
   str << "Accelerator Config: \n";
   str << ".dat file directory: " << datDirectory_ << "\n";
   str << "PA file prefix: " << PAname_ << "\n";
+  str << ".pa file directory: " << ((paDirectory_.empty()) ? "none (using .dat files)" : paDirectory_) << "\n";
+  str << "Solve Laplace: " << ((solveLaplace_) ? "on" : "off") << " (tolerance " << laplaceTolerance_ << ")\n";
   str << "Number of electrodes: " << nElectrodes_ << "\n";
-  str << "Dimensions (x, y, z): (" << x_ << ", " << y_ << ", " << z_ << ")";
+  str << "Dimensions (x, y, z): (" << x_ << ", " << y_ << ", " << z_ << ")\n";
+  str << "Field cache: " << ((useFieldCache_) ? (fieldCache_.empty() ? "default" : fieldCache_) : "off") << "\n";
+  str << "Shared memory: " << ((sharedMemory_) ? (shmName_.empty() ? "default" : shmName_) : "off") << "\n";
+  str << "Basis storage: " << basisStorage_ << "\n";
+  str << "Support cutoff: " << supportCutoff_ << "\n";
+  str << "Rotational symmetry: " << ((rotationalSymmetry_) ? "on" : "off") << "\n";
+  str << "Periodic: " << ((periodic_) ? "on" : "off") << "\n";
+  str << "Symmetry tolerance: " << symmetryTolerance_ << "\n";
+  str << "Lazy loading: " << ((lazyLoading_) ? "on" : "off") << " (" << prefetchSections_ << " sections ahead)\n";
+  str << "Interleaved basis: " << ((interleavedBasis_) ? "on" : "off");
 
   out << str.str();
 }
@@ -48,6 +85,22 @@ const std::string& AcceleratorConfig::PAname() const {
   return PAname_;
 }
 
+const std::string& AcceleratorConfig::paDirectory() const {
+  return paDirectory_;
+}
+
+double AcceleratorConfig::paPixelSize() const {
+  return paPixelSize_;
+}
+
+bool AcceleratorConfig::solveLaplace() const {
+  return solveLaplace_;
+}
+
+double AcceleratorConfig::laplaceTolerance() const {
+  return laplaceTolerance_;
+}
+
 int AcceleratorConfig::x() const {
   return x_;
 }
@@ -60,6 +113,77 @@ int AcceleratorConfig::z() const {
   return z_;
 }
 
+bool AcceleratorConfig::useFieldCache() const {
+  return useFieldCache_;
+}
+
+const std::string& AcceleratorConfig::fieldCache() const {
+  return fieldCache_;
+}
+
+bool AcceleratorConfig::sharedMemory() const {
+  return sharedMemory_;
+}
+
+const std::string& AcceleratorConfig::shmName() const {
+  return shmName_;
+}
+
+const std::string& AcceleratorConfig::basisStorage() const {
+  return basisStorage_;
+}
+
+float AcceleratorConfig::supportCutoff() const {
+  return supportCutoff_;
+}
+
+bool AcceleratorConfig::rotationalSymmetry() const {
+  return rotationalSymmetry_;
+}
+
+bool AcceleratorConfig::periodic() const {
+  return periodic_;
+}
+
+float AcceleratorConfig::symmetryTolerance() const {
+  return symmetryTolerance_;
+}
+
+bool AcceleratorConfig::lazyLoading() const {
+  return lazyLoading_;
+}
+
+int AcceleratorConfig::prefetchSections() const {
+  return prefetchSections_;
+}
+
+bool AcceleratorConfig::interleavedBasis() const {
+  return interleavedBasis_;
+}
+
+std::string AcceleratorConfig::datPath(int electrodeNumber, int x, int d) const {
+  std::stringstream path;
+
+  // x+2 to correct zero-indexing, and (nElectrodes - electrodeNumber + 1) to correct weird backwards numbering
+  path << datDirectory_ << PAname_ << "_E" << nElectrodes_ - electrodeNumber + 1
+       << "_L" << x + 2 << "_" << Physics::axes[d] << ".dat";
+
+  return path.str();
+}
+
+std::string AcceleratorConfig::paPath(int electrodeNumber) const {
+  std::stringstream path;
+
+  // Numbered backwards, like the .dat files
+  path << paDirectory_ << PAname_ << ".pa" << nElectrodes_ - electrodeNumber + 1;
+
+  return path.str();
+}
+
+std::string AcceleratorConfig::paGeometryPath() const {
+  return paDirectory_ + PAname_ + ".pa#";
+}
+
 SimulationConfig::SimulationConfig(INIReader &reader) {
   populate(reader);
 }
@@ -79,6 +203,79 @@ void SimulationConfig::populate(INIReader &reader) {
 
   duration_ = (float) reader.GetReal("simulation", "duration", 6e-4);
   inglisTeller_ = reader.GetBoolean("simulation", "inglis_teller", false);
+  interpolateField_ = reader.GetBoolean("simulation", "interpolate_field", false);
+  fieldEvaluation_ = reader.Get("simulation", "field_evaluation", "lazy");
+  if (fieldEvaluation_ != "auto" && fieldEvaluation_ != "lazy" && fieldEvaluation_ != "dense") {
+    try {
+      throw "Invalid value for field evaluation!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  fieldWindow_ = reader.GetInteger("simulation", "field_window", 0);
+  if (fieldWindow_ < 0) {
+    try {
+      throw "The field window's margin can't be negative!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  phaseTable_ = reader.GetInteger("simulation", "phase_table", 0);
+  if (phaseTable_ < 0) {
+    try {
+      throw "The number of trap phases to tabulate can't be negative!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  compactionInterval_ = reader.GetInteger("simulation", "compaction_interval", 100);
+  if (compactionInterval_ < 0) {
+    try {
+      throw "The compaction interval can't be negative!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  sortInterval_ = reader.GetInteger("simulation", "sort_interval", 0);
+  if (sortInterval_ < 0) {
+    try {
+      throw "The sort interval can't be negative!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  integrator_ = reader.Get("simulation", "integrator", "euler");
+  if (integrator_ != "euler" && integrator_ != "leapfrog" && integrator_ != "forest_ruth") {
+    try {
+      throw "Invalid value for integrator!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  substepGradient_ = (float) reader.GetReal("simulation", "substep_gradient", 0);
+  if (substepGradient_ < 0) {
+    try {
+      throw "The sub-stepping gradient can't be negative!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
+  maxSubsteps_ = reader.GetInteger("simulation", "max_substeps", 8);
+  if (maxSubsteps_ < 1) {
+    try {
+      throw "There must be at least one sub-step!";
+    } catch (const char* e) {
+      std::cout << e << std::endl;
+      std::terminate();
+    }
+  }
   maxVoltage_ = (float) reader.GetReal("simulation", "max_voltage", 100);
   targetVel_ = (float) reader.GetReal("simulation", "target_vel", 500);
   timeStep_ = (float) reader.GetReal("simulation", "time_step", 1e-6);
@@ -94,6 +291,15 @@ void SimulationConfig::printOn(std::ostream &out) {
   str << "Trap shake time: " << trapShakeTime_ << "\n";
   str << "Max voltage: " << maxVoltage_ << "\n";
   str << "Target velocity: " << targetVel_ << "\n";
+  str << "Field interpolation: " << ((interpolateField_) ? "on" : "off") << "\n";
+  str << "Field evaluation: " << fieldEvaluation_ << "\n";
+  str << "Field window margin: " << fieldWindow_ << "\n";
+  str << "Tabulated trap phases: " << phaseTable_ << "\n";
+  str << "Compaction interval: " << compactionInterval_ << "\n";
+  str << "Sort interval: " << sortInterval_ << "\n";
+  str << "Integrator: " << integrator_ << "\n";
+  str << "Sub-stepping gradient: " << substepGradient_ << "\n";
+  str << "Max sub-steps: " << maxSubsteps_ << "\n";
 
 #pragma GCC diagnostic push // Makes g++ shut up about these ternary operators supposedly having no effect
 #pragma GCC diagnostic ignored "-Wunused-value"
@@ -120,6 +326,42 @@ bool SimulationConfig::inglisTeller() const {
   return inglisTeller_;
 }
 
+bool SimulationConfig::interpolateField() const {
+  return interpolateField_;
+}
+
+const std::string& SimulationConfig::fieldEvaluation() const {
+  return fieldEvaluation_;
+}
+
+int SimulationConfig::fieldWindow() const {
+  return fieldWindow_;
+}
+
+int SimulationConfig::phaseTable() const {
+  return phaseTable_;
+}
+
+int SimulationConfig::compactionInterval() const {
+  return compactionInterval_;
+}
+
+int SimulationConfig::sortInterval() const {
+  return sortInterval_;
+}
+
+const std::string& SimulationConfig::integrator() const {
+  return integrator_;
+}
+
+float SimulationConfig::substepGradient() const {
+  return substepGradient_;
+}
+
+int SimulationConfig::maxSubsteps() const {
+  return maxSubsteps_;
+}
+
 float SimulationConfig::maxVoltage() const {
   return maxVoltage_;
 }
@@ -148,6 +390,42 @@ void SimulationConfig::setInglisTeller(bool inglisTeller) {
   inglisTeller_ = inglisTeller;
 }
 
+void SimulationConfig::setInterpolateField(bool interpolateField) {
+  interpolateField_ = interpolateField;
+}
+
+void SimulationConfig::setFieldEvaluation(const std::string &evaluation) {
+  fieldEvaluation_ = evaluation;
+}
+
+void SimulationConfig::setFieldWindow(int margin) {
+  fieldWindow_ = margin;
+}
+
+void SimulationConfig::setPhaseTable(int nPhases) {
+  phaseTable_ = nPhases;
+}
+
+void SimulationConfig::setCompactionInterval(int interval) {
+  compactionInterval_ = interval;
+}
+
+void SimulationConfig::setSortInterval(int interval) {
+  sortInterval_ = interval;
+}
+
+void SimulationConfig::setIntegrator(const std::string &integrator) {
+  integrator_ = integrator;
+}
+
+void SimulationConfig::setSubstepGradient(float gradient) {
+  substepGradient_ = gradient;
+}
+
+void SimulationConfig::setMaxSubsteps(int maxSubsteps) {
+  maxSubsteps_ = maxSubsteps;
+}
+
 void SimulationConfig::setMaxVoltage(float maxVoltage) {
   maxVoltage_ = maxVoltage;
 }
@@ -51,6 +51,22 @@ class AcceleratorConfig : public SubConfig {
   int x_, y_, z_;  ///@}
   std::string datDirectory_;  //!< Directory in which the E-Field .dat files are stored
   std::string PAname_;  //!< prefix for EXSIMECK-named files
+  std::string paDirectory_;  //!< Directory in which the SIMION .pa files are stored (empty to use the .dat files)
+  double paPixelSize_;  //!< The distance between points in the .pa files (mm)
+  bool solveLaplace_;  //!< Whether to solve for the fields from the SIMION geometry (.pa#) file, instead of reading them
+  double laplaceTolerance_;  //!< Largest update (as a fraction of the electrode voltage) at which the Laplace solver stops
+  bool useFieldCache_;  //!< Whether to read/write the binary field cache
+  std::string fieldCache_;  //!< Path to the binary field cache (empty for the default)
+  bool sharedMemory_;  //!< Whether to share the imported fields with other processes through shared memory
+  std::string shmName_;  //!< Name of the shared memory segment (empty for the default)
+  std::string basisStorage_;  //!< How the Electrodes store their fields: float32, float16 or int16
+  float supportCutoff_;  //!< Fraction of each Electrode's peak |E| below which its field is dropped
+  bool rotationalSymmetry_;  //!< Whether to store the Electrodes in a section as rotations of each other where possible
+  bool periodic_;  //!< Whether to store each section's Electrodes as the previous section's moved along z where possible
+  float symmetryTolerance_;  //!< Largest error (as a fraction of the peak field) allowed when storing an Electrode as an image
+  bool lazyLoading_;  //!< Whether to load each Electrode in the background just before it's first given a voltage
+  int prefetchSections_;  //!< How many sections ahead of the voltage scheme to load Electrodes, when loading lazily
+  bool interleavedBasis_;  //!< Whether to keep a copy of the basis with the electrodes varying fastest, for superposing
 
   //!< @copydoc SubConfig::printOn()
   void printOn(std::ostream &out);
@@ -76,6 +92,18 @@ class AcceleratorConfig : public SubConfig {
   /** @brief Prefix for EXSIMECK-named files */
   const std::string& PAname() const;
 
+  /** @brief Directory in which the SIMION .pa files are stored (empty to use the .dat files) */
+  const std::string& paDirectory() const;
+
+  /** @brief The distance between points in the .pa files (mm) */
+  double paPixelSize() const;
+
+  /** @brief Whether to solve for the fields from the SIMION geometry (.pa#) file, instead of reading them */
+  bool solveLaplace() const;
+
+  /** @brief Largest update (as a fraction of the electrode voltage) at which the Laplace solver stops */
+  double laplaceTolerance() const;
+
   /** @brief Dimension in x of accelerator geometry */
   int x() const;
 
@@ -84,6 +112,61 @@ class AcceleratorConfig : public SubConfig {
 
   /** @brief Dimension in z of accelerator geometry */
   int z() const;
+
+  /** @brief Whether to read/write the binary field cache */
+  bool useFieldCache() const;
+
+  /** @brief Path to the binary field cache (empty for the default) */
+  const std::string& fieldCache() const;
+
+  /** @brief Whether to share the imported fields with other processes through shared memory */
+  bool sharedMemory() const;
+
+  /** @brief Name of the shared memory segment (empty for the default) */
+  const std::string& shmName() const;
+
+  /** @brief How the Electrodes store their fields: float32, float16 or int16 */
+  const std::string& basisStorage() const;
+
+  /** @brief Fraction of each Electrode's peak |E| below which its field is dropped (0 keeps everything) */
+  float supportCutoff() const;
+
+  /** @brief Whether to store the Electrodes in a section as rotations of each other where possible */
+  bool rotationalSymmetry() const;
+
+  /** @brief Whether to store each section's Electrodes as the previous section's moved along z where possible */
+  bool periodic() const;
+
+  /** @brief Largest error (as a fraction of the peak field) allowed when storing an Electrode as an image */
+  float symmetryTolerance() const;
+
+  /** @brief Whether to load each Electrode in the background just before it's first given a voltage */
+  bool lazyLoading() const;
+
+  /** @brief How many sections ahead of the voltage scheme to load Electrodes, when loading lazily */
+  int prefetchSections() const;
+
+  /** @brief Whether to keep a copy of the basis with the electrodes varying fastest, for superposing */
+  bool interleavedBasis() const;
+
+  /** @brief Path to an EXSIMECK .dat file
+   *
+   * @param electrodeNumber The (1-indexed) number of the electrode in the geometry
+   * @param x The (0-indexed) x-layer
+   * @param d The dimension (0 = x, 1 = y, 2 = z)
+   * @return The path to the .dat file for that electrode, layer and dimension
+   */
+  std::string datPath(int electrodeNumber, int x, int d) const;
+
+  /** @brief Path to a SIMION .pa file
+   *
+   * @param electrodeNumber The (1-indexed) number of the electrode in the geometry
+   * @return The path to the electrode's fast adjust (.paN) file
+   */
+  std::string paPath(int electrodeNumber) const;
+
+  /** @brief Path to the SIMION geometry (.pa#) file, which the Laplace solver reads */
+  std::string paGeometryPath() const;
 };
 
 /** @brief For storing configuration data pertaining to the nature of the simulation
@@ -99,6 +182,15 @@ class SimulationConfig : public SubConfig {
   std::string accelerationScheme_;  //!< Scheme for acceleration: trap, inst or exp
   float trapShakeTime_; //!< The amount of time to ramp up the trap voltage for before it moves
   bool inglisTeller_;  //!< Whether to neutralise the dipole moment of particles past the I-T limit
+  bool interpolateField_;  //!< Whether to interpolate the field between grid points, instead of rounding to the nearest
+  std::string fieldEvaluation_;  //!< How to evaluate the field: lazy, dense or auto
+  int fieldWindow_;  //!< The margin of the window around the particles that the field is kept in (0 to keep it everywhere)
+  int phaseTable_;  //!< The number of trap phases to tabulate the field at (0 to blend the field every step)
+  int compactionInterval_;  //!< The number of time steps between dropping particles that have stopped (0 never to)
+  int sortInterval_;  //!< The number of time steps between sorting the particles by where they are (0 never to)
+  std::string integrator_;  //!< How to move the particles through a time step: euler, leapfrog or forest_ruth
+  float substepGradient_;  //!< The field gradient above which a particle's time step is split up (0 never to)
+  int maxSubsteps_;  //!< The most pieces that a particle's time step is split into
 
   //!< @copydoc SubConfig::printOn()
   void printOn(std::ostream &out);
@@ -128,6 +220,33 @@ class SimulationConfig : public SubConfig {
   /** @brief Whether to neutralise the dipole moment of particles past the I-T limit */
   bool inglisTeller() const;
 
+  /** @brief Whether to interpolate the field between grid points, instead of rounding to the nearest */
+  bool interpolateField() const;
+
+  /** @brief How to evaluate the field: lazy (memoised per point), dense (whole sweeps) or auto (chosen by Simulator) */
+  const std::string& fieldEvaluation() const;
+
+  /** @brief The margin of the window around the particles that the field is kept in (grid points, 0 to keep it everywhere) */
+  int fieldWindow() const;
+
+  /** @brief The number of trap phases to tabulate the field at (0 to blend the field every step) */
+  int phaseTable() const;
+
+  /** @brief The number of time steps between dropping particles that have stopped from the loop (0 never to) */
+  int compactionInterval() const;
+
+  /** @brief The number of time steps between sorting the particles by where they are in the grid (0 never to) */
+  int sortInterval() const;
+
+  /** @brief How to move the particles through a time step: euler, leapfrog or forest_ruth */
+  const std::string& integrator() const;
+
+  /** @brief The magnitude of the field gradient above which a particle's time step is split up (V/m^2, 0 never to) */
+  float substepGradient() const;
+
+  /** @brief The most pieces that a particle's time step is split into */
+  int maxSubsteps() const;
+
   /** @brief Maximum voltage that can be applied to electrodes (V) */
   float maxVoltage() const;
 
@@ -161,6 +280,60 @@ class SimulationConfig : public SubConfig {
    */
   void setInglisTeller(bool inglisTeller);
 
+  /** @brief Setter for whether to interpolate the field between grid points
+   *
+   * @param interpolateField True if interpolating
+   */
+  void setInterpolateField(bool interpolateField);
+
+  /** @brief Setter for how to evaluate the field
+   *
+   * @param evaluation String representing the evaluation: "lazy", "dense" or "auto"
+   */
+  void setFieldEvaluation(const std::string &evaluation);
+
+  /** @brief Setter for the field window
+   *
+   * @param margin The margin around the particles (grid points), or 0 to keep the field everywhere
+   */
+  void setFieldWindow(int margin);
+
+  /** @brief Setter for the phase table
+   *
+   * @param nPhases The number of trap phases to tabulate, or 0 not to
+   */
+  void setPhaseTable(int nPhases);
+
+  /** @brief Setter for the compaction interval
+   *
+   * @param interval The number of time steps between dropping particles that have stopped, or 0 never to
+   */
+  void setCompactionInterval(int interval);
+
+  /** @brief Setter for the sort interval
+   *
+   * @param interval The number of time steps between sorting the particles by where they are, or 0 never to
+   */
+  void setSortInterval(int interval);
+
+  /** @brief Setter for the integrator
+   *
+   * @param integrator String representing the integrator: "euler", "leapfrog" or "forest_ruth"
+   */
+  void setIntegrator(const std::string &integrator);
+
+  /** @brief Setter for the sub-stepping gradient
+   *
+   * @param gradient The magnitude of the field gradient above which time steps are split up (V/m^2), or 0 never to
+   */
+  void setSubstepGradient(float gradient);
+
+  /** @brief Setter for the maximum number of sub-steps
+   *
+   * @param maxSubsteps The most pieces that a time step is split into
+   */
+  void setMaxSubsteps(int maxSubsteps);
+
   /** @brief Setter for maximum voltage to apply to electrodes
    *
    * @param maxVoltage Maximum voltage to apply to electrodes
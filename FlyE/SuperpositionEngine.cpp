@@ -0,0 +1,64 @@
+#include "SuperpositionEngine.h"
+
+#include <algorithm>
+
+#include "Electrode.h"
+
+constexpr int SuperpositionEngine::SLAB_DEPTH;
+constexpr size_t SuperpositionEngine::TILE_BYTES;
+
+SuperpositionEngine::SuperpositionEngine() {
+}
+
+SuperpositionEngine::SuperpositionEngine(int x, int y, int z) {
+  const int depth = std::min(SLAB_DEPTH, z);
+  const size_t rowBytes = sizeof(blitz::TinyVector<float, 3>) * y * depth;  // One x of a slab
+  const int width = std::max<int>(1, TILE_BYTES / rowBytes);
+
+  for (int z0 = 0; z0 < z; z0 += depth) {
+    for (int x0 = 0; x0 < x; x0 += width) {
+      tiles_.push_back(GridBox(x0, 0, z0, std::min(x0 + width, x) - 1, y - 1, std::min(z0 + depth, z) - 1));
+    }
+  }
+}
+
+void SuperpositionEngine::superpose(const std::vector<std::shared_ptr<Electrode> > &electrodes,
+                                    const std::vector<float> &voltages, VectorField &field) const {
+  const long nTiles = tiles_.size();
+
+#pragma omp parallel for schedule(dynamic)
+  for (long t = 0; t < nTiles; ++t) {
+    const GridBox &tile = tiles_[t];
+
+    for (int x = tile.x0; x <= tile.x1; ++x) {
+      for (int y = tile.y0; y <= tile.y1; ++y) {
+        float *row = reinterpret_cast<float*>(&field(x, y, tile.z0));
+        std::fill(row, row + 3 * (tile.z1 - tile.z0 + 1), 0.0);
+      }
+    }
+
+    for (unsigned int e = 0; e < electrodes.size(); ++e) {
+      if (voltages[e] == 0.0) continue;
+
+      GridBox overlap = tile.grown(0, electrodes[e]->support());  // The part of the tile in the support
+      if (overlap.empty()) continue;
+
+      for (int x = overlap.x0; x <= overlap.x1; ++x) {
+        for (int y = overlap.y0; y <= overlap.y1; ++y) {
+          float *row = reinterpret_cast<float*>(&field(x, y, overlap.z0));
+
+          for (int z = overlap.z0; z <= overlap.z1; ++z, row += 3) {
+            blitz::TinyVector<float, 3> point = electrodes[e]->fieldAt(x, y, z);
+            row[0] += voltages[e] * point[0];
+            row[1] += voltages[e] * point[1];
+            row[2] += voltages[e] * point[2];
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t SuperpositionEngine::nTiles() const {
+  return tiles_.size();
+}
@@ -0,0 +1,61 @@
+/**@file SuperpositionEngine.h
+ * @brief This file contains the SuperpositionEngine class
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "GridBox.h"
+#include "VectorField.h"
+
+class Electrode;
+
+/** @brief Sums Electrodes' fields times their voltages over the whole grid, in parallel and deterministically
+ *
+ * Adding each Electrode to the field in turn streams the whole field through memory once per Electrode, and doing that
+ * for several Electrodes at once races on the field. Instead, the grid is cut into tiles: slabs of SLAB_DEPTH z-planes,
+ * each split into runs of x small enough that a tile fits in TILE_BYTES (about an L2 cache). Each tile belongs to one
+ * thread, which adds every Electrode into it in order while it's in cache.
+ *
+ * Every point is summed by one thread, in Electrode order, so the result is bit-for-bit the same for any number of threads
+ * (and the same as adding the Electrodes one at a time).
+ *
+ * @author Jamie Parkinson <jamie.parkinson.12@ucl.ac.uk>
+ */
+class SuperpositionEngine {
+ protected:
+  std::vector<GridBox> tiles_; //!< The tiles that the grid is cut into
+
+ public:
+  static constexpr int SLAB_DEPTH = 64; //!< The number of z-planes in each slab (the length of each contiguous run)
+  static constexpr size_t TILE_BYTES = 256 * 1024; //!< The most of the field that a tile should hold (bytes)
+
+  /** @brief Blank constructor, has no tiles */
+  SuperpositionEngine();
+
+  /** @brief Cuts a grid into tiles
+   *
+   * @param x The size of the grid along x
+   * @param y The size of the grid along y
+   * @param z The size of the grid along z
+   */
+  SuperpositionEngine(int x, int y, int z);
+
+  /** @brief Overwrites a field with the sum of the Electrodes' fields, each times a voltage
+   *
+   * Electrodes with no voltage are skipped (so they needn't be loaded).
+   *
+   * @param electrodes The Electrodes
+   * @param voltages A voltage for each Electrode
+   * @param[out] field The field to overwrite, the same size as the grid
+   */
+  void superpose(const std::vector< std::shared_ptr<Electrode> > &electrodes, const std::vector<float> &voltages,
+                 VectorField &field) const;
+
+  /** @brief The number of tiles that the grid is cut into */
+  size_t nTiles() const;
+};
@@ -1,6 +1,7 @@
 #include "VoltageScheme.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "Particle.h"
@@ -18,6 +19,18 @@ VoltageScheme::VoltageScheme(float maxVoltage, int nElectrodes,
       timeStep_(timeStep) {
 }
 
+std::vector<bool> VoltageScheme::upcomingElectrodes(int nSections) {
+  return std::vector<bool>(nElectrodes_, true);
+}
+
+std::vector<std::vector<float> > VoltageScheme::modePatterns() {
+  return std::vector<std::vector<float> >();
+}
+
+std::vector<float> VoltageScheme::modeCoefficients(int t) {
+  return std::vector<float>();
+}
+
 //Synchronous
 SynchronousParticleScheme::SynchronousParticleScheme(
     Particle &synchronousParticle, float maxVoltage, int nElectrodes,
@@ -33,6 +46,15 @@ std::vector<float> SynchronousParticleScheme::getInitialVoltages() {
   return voltages_;
 }
 
+std::vector<bool> SynchronousParticleScheme::upcomingElectrodes(int nSections) {
+  std::vector<bool> upcoming(nElectrodes_, false);
+  int nUpcoming = std::min(Physics::N_IN_SECTION * (section_ - 1 + nSections), nElectrodes_);
+
+  std::fill(upcoming.begin(), upcoming.begin() + nUpcoming, true);
+
+  return upcoming;
+}
+
 // Instantaneous
 InstantaneousScheme::InstantaneousScheme(Particle &synchronousParticle,
                                          float maxVoltage, int nElectrodes,
@@ -155,18 +177,16 @@ std::vector<float> MovingTrapScheme::getInitialVoltages() {
   return getVoltages(0);
 }
 
-std::vector<float> MovingTrapScheme::getVoltages(int t) {
+bool MovingTrapScheme::trapState(int t, float &voltage, float &phase) {
   float tSeconds = t * timeStep_;
-  float voltage = maxVoltage_;
+  voltage = maxVoltage_;
 
   // If the next step is the point where we turn it off, do that now
   if (tSeconds + timeStep_ >= offTime_) {
-    std::fill(voltages_.begin(), voltages_.end(), 0.0);
-    return voltages_;
+    return false;
   }
 
   // Deal with ramp-up stage
-  float phase;
   if (tSeconds <= shakeTime_) {
     voltage = maxVoltage_ * (0.3 + tSeconds * 0.7 / shakeTime_);
     phase = 0.8 * sin(3 * M_PI * tSeconds / shakeTime_);
@@ -175,6 +195,17 @@ std::vector<float> MovingTrapScheme::getVoltages(int t) {
         * Physics::MM_M_FACTOR / (offTime_ * sectionWidth_ * trapWidth_);
   }
 
+  return true;
+}
+
+std::vector<float> MovingTrapScheme::getVoltages(int t) {
+  float voltage, phase;
+
+  if (!trapState(t, voltage, phase)) {
+    std::fill(voltages_.begin(), voltages_.end(), 0.0);
+    return voltages_;
+  }
+
   std::vector<int> listOfEs(nElectrodes_);
   std::iota(listOfEs.begin(), listOfEs.end(), 4);  // Create range 4:1:nElectrodes_
   // Transform into something like 1 1 1 1 2 2 2 2 3 3 3 3 etc
@@ -191,3 +222,27 @@ std::vector<float> MovingTrapScheme::getVoltages(int t) {
 
   return voltages_;
 }
+
+std::vector<std::vector<float> > MovingTrapScheme::modePatterns() {
+  std::vector<std::vector<float> > patterns(2, std::vector<float>(nElectrodes_));
+
+  for (int e = 0; e < nElectrodes_; ++e) {
+    int section = (e + 4) / Physics::N_IN_SECTION;  // The same numbering as getVoltages()
+    double angle = 2 * M_PI * (section % trapWidth_) / trapWidth_;
+
+    patterns[0][e] = cos(angle);
+    patterns[1][e] = sin(angle);
+  }
+
+  return patterns;
+}
+
+std::vector<float> MovingTrapScheme::modeCoefficients(int t) {
+  float voltage, phase;
+
+  if (!trapState(t, voltage, phase)) {
+    return std::vector<float>(2, 0.0);
+  }
+
+  return {voltage * std::cos(phase), voltage * std::sin(phase)};
+}
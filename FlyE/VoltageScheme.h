@@ -47,6 +47,31 @@ class VoltageScheme {
    */
   virtual std::vector<float> getInitialVoltages() = 0;
 
+  /** @brief Which electrodes might be given a voltage soon
+   *
+   * Used to load electrodes before they're needed. By default, every electrode might be.
+   *
+   * @param nSections How many sections ahead to look
+   * @return Whether each electrode might be given a (non-zero) voltage within the next nSections sections
+   */
+  virtual std::vector<bool> upcomingElectrodes(int nSections);
+
+  /** @brief Fixed patterns of voltages that the scheme's voltages are always a combination of (if there are any)
+   *
+   * If a scheme gives any patterns, getVoltages(t) must equal the sum over m of modeCoefficients(t)[m] * modePatterns()[m],
+   * so the field can be made by blending the patterns' fields instead of summing every electrode. By default, there are none.
+   *
+   * @return A vector of voltages (one for each electrode) for each pattern
+   */
+  virtual std::vector<std::vector<float> > modePatterns();
+
+  /** @brief How much of each of modePatterns() makes up the voltages at time t
+   *
+   * @param t Time to get the coefficients for
+   * @return A coefficient for each pattern
+   */
+  virtual std::vector<float> modeCoefficients(int t);
+
   /** @brief Returns true if the voltages will be different from the previous access
    *
    * @param t The time to check activity
@@ -88,6 +113,12 @@ class SynchronousParticleScheme : public VoltageScheme {
   virtual bool isActive(int t) = 0;
 
   std::vector<float> getInitialVoltages();
+
+  /** @brief The electrodes up to nSections past the section that the synchronous particle is in
+   *
+   * @copydetails VoltageScheme::upcomingElectrodes()
+   */
+  std::vector<bool> upcomingElectrodes(int nSections);
 };
 
 /** @brief A SynchronousParticleScheme that switches on sections instantaneously as the synchronous particle enters them
@@ -146,6 +177,15 @@ class MovingTrapScheme : public VoltageScheme {
    */
   float frequency(int k);
 
+  /** @brief The amplitude and phase of the trap's voltages at time t
+   *
+   * @param t The time step
+   * @param[out] voltage The amplitude of the voltages
+   * @param[out] phase The phase of the trap
+   * @return false if the trap should be switched off
+   */
+  bool trapState(int t, float &voltage, float &phase);
+
  public:
   /** @brief Constructs the MovingTrapScheme with the appropriate parameters
    *
@@ -163,5 +203,19 @@ class MovingTrapScheme : public VoltageScheme {
 
   std::vector<float> getVoltages(int t);
 
+  /** @brief The cosine and sine of each electrode's position in the trap
+   *
+   * Each voltage is voltage * cos(angle - phase) = voltage * (cos(phase) * cos(angle) + sin(phase) * sin(angle)).
+   *
+   * @copydetails VoltageScheme::modePatterns()
+   */
+  std::vector<std::vector<float> > modePatterns();
+
+  /** @brief voltage * cos(phase) and voltage * sin(phase)
+   *
+   * @copydetails VoltageScheme::modeCoefficients()
+   */
+  std::vector<float> modeCoefficients(int t);
+
   bool isActive(int t);
 };